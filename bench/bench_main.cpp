@@ -0,0 +1,921 @@
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <stdint.h>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "rasterizer_graphics.h"
+#include "rasterizer_math.h"
+#include "rasterizer_simd.h"
+#include "rasterizer_jobs.h"
+#include "rasterizer_vertex.h"
+#include "rasterizer_tiles.h"
+#include "rasterizer_texture.h"
+#include "rasterizer_mesh.h"
+#include "rasterizer_clip.h"
+#include "rasterizer_scene.h"
+
+// Usage: 3DRasterizer_bench [--frames N] [--res 720p|1080p|4k|all] [--threads N] [--out file.json]
+
+struct Resolution
+{
+    const char *name;
+    u32 width;
+    u32 height;
+};
+
+struct StageResult
+{
+    const char *name;
+    double minMs;
+    double medianMs;
+    double p99Ms;
+    double pixelsPerCall;
+    double primitivesPerCall;
+};
+
+globalVariable Resolution resolutions[] =
+{
+    {"720p",  1280, 720},
+    {"1080p", 1920, 1080},
+    {"4k",    3840, 2160},
+};
+
+globalVariable u32 randomState = 0x12345678;
+
+// Deterministic LCG so every run draws the same workload
+static u32 nextRandom()
+{
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 8;
+}
+
+static i32 randomRange(i32 lo, i32 hi)
+{
+    return lo + (i32)(nextRandom() % (u32)(hi - lo));
+}
+
+static double nowMs()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static double percentile(std::vector<double> &sorted, double p)
+{
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Runs body once per frame and reduces the per-frame times
+template <typename Body>
+static StageResult measureStage(const char *name, int frames, double pixels, double primitives, Body body)
+{
+    std::vector<double> times(frames);
+
+    // Warm caches and page in the buffers before timing
+    body();
+
+    for(int i = 0; i < frames; i++)
+    {
+        double start = nowMs();
+        body();
+        times[i] = nowMs() - start;
+    }
+
+    std::sort(times.begin(), times.end());
+
+    StageResult result;
+    result.name = name;
+    result.minMs = times[0];
+    result.medianMs = percentile(times, 0.5);
+    result.p99Ms = percentile(times, 0.99);
+    result.pixelsPerCall = pixels;
+    result.primitivesPerCall = primitives;
+    return result;
+}
+
+static void writeStage(FILE *out, StageResult &stage, bool last)
+{
+    double seconds = stage.medianMs / 1000.0;
+    double mpixels = seconds > 0 ? stage.pixelsPerCall / seconds / 1e6 : 0;
+    double prims = seconds > 0 ? stage.primitivesPerCall / seconds : 0;
+
+    fprintf(out, "        {\"stage\": \"%s\", \"min_ms\": %.4f, \"median_ms\": %.4f, \"p99_ms\": %.4f, "
+                 "\"mpixels_per_s\": %.2f, \"primitives_per_s\": %.1f}%s\n",
+            stage.name, stage.minMs, stage.medianMs, stage.p99Ms, mpixels, prims, last ? "" : ",");
+}
+
+// Each clear kernel against memset, which approximates the achievable
+// write bandwidth with ordinary stores on this machine
+static void writeClearKernels(FILE *out, int frames)
+{
+    size_t count = (size_t) buffer.width * buffer.height;
+    double bytes = (double) count * sizeof(u32);
+
+    StageResult ceiling = measureStage("memset", frames, 0, 0, [&]()
+    {
+        memset(buffer.buffer, 0, count * sizeof(u32));
+    });
+    double ceilingGBs = bytes / (ceiling.medianMs / 1000.0) / 1e9;
+
+    struct ClearKernel { const char *name; ClearFunction function; bool supported; };
+    ClearKernel kernels[] =
+    {
+        {"scalar", Simd_clearScalar, true},
+        {"sse2",   Simd_clearSSE2,   cpuFeatures.sse2},
+        {"avx2",   Simd_clearAVX2,   cpuFeatures.avx2},
+        {"avx512", Simd_clearAVX512, cpuFeatures.avx512f},
+    };
+
+    fprintf(out, "      \"clear_kernels\": {\"dispatched\": \"%s\", \"memset_gb_per_s\": %.2f, \"kernels\": [\n",
+            Simd_levelName(simdLevel), ceilingGBs);
+
+    bool first = true;
+    for(ClearKernel &kernel : kernels)
+    {
+        if(!kernel.supported) continue;
+
+        StageResult result = measureStage(kernel.name, frames, 0, 0, [&]()
+        {
+            kernel.function(buffer.buffer, count, 0xFF000000);
+        });
+        double gbs = bytes / (result.medianMs / 1000.0) / 1e9;
+
+        fprintf(out, "%s        {\"kernel\": \"%s\", \"median_ms\": %.4f, \"gb_per_s\": %.2f, \"fraction_of_memset\": %.3f}",
+                first ? "" : ",\n", kernel.name, result.medianMs, gbs, gbs / ceilingGBs);
+        first = false;
+    }
+
+    fprintf(out, "\n      ]}\n");
+}
+
+// Hardware event counts of one thread, user space only. Counters are -1 where
+// perf events aren't available (other platforms, containers, perf_event_paranoid).
+struct EventCounts
+{
+    i64 cacheMisses;
+    i64 l1dMisses;
+};
+
+#ifdef __linux__
+static int openCounter(u32 type, u64 config)
+{
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+template <typename Body>
+static EventCounts countEvents(int frames, Body body)
+{
+    int fds[2] =
+    {
+        openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES),
+        openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)),
+    };
+    i64 counts[2] = {-1, -1};
+
+    for(int fd : fds)
+    {
+        if(fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    for(int i = 0; i < frames; i++)
+        body();
+
+    for(int c = 0; c < 2; c++)
+    {
+        if(fds[c] < 0) continue;
+
+        ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+        u64 value;
+        if(read(fds[c], &value, sizeof(value)) == sizeof(value))
+            counts[c] = (i64) value;
+        close(fds[c]);
+    }
+
+    return {counts[0], counts[1]};
+}
+#else
+template <typename Body>
+static EventCounts countEvents(int frames, Body body)
+{
+    for(int i = 0; i < frames; i++)
+        body();
+
+    return {-1, -1};
+}
+#endif
+
+static void writeCount(FILE *out, const char *name, i64 count, int frames)
+{
+    if(count < 0)
+        fprintf(out, "\"%s\": null", name);
+    else
+        fprintf(out, "\"%s\": %.0f", name, (double) count / frames);
+}
+
+// Row-major against 4x4 blocked storage, sampling level 0 of a texture much
+// larger than the caches at one texel per pixel. At 0 degrees rows walk along
+// texture rows, at 90 degrees they walk down columns. Independent of the
+// framebuffer, so it runs once rather than per resolution.
+static void writeTextureLayouts(FILE *out, int frames)
+{
+    const int TEXTURE_SIZE = 4096;
+    const int OUTPUT_SIZE = 1024;
+    std::vector<u32> source((size_t) TEXTURE_SIZE * TEXTURE_SIZE);
+    std::vector<u32> row(OUTPUT_SIZE);
+
+    for(u32 &texel : source)
+        texel = 0xFF000000 | nextRandom();
+
+    struct Layout { const char *name; TEXTURE_LAYOUT layout; };
+    Layout layouts[] = {{"linear", LAYOUT_LINEAR}, {"blocked", LAYOUT_BLOCKED}};
+    int angles[] = {0, 90};
+
+    fprintf(out, "  \"texture_layouts\": {\"texture_size\": %d, \"output_size\": %d, \"filter\": \"bilinear\", \"runs\": [\n",
+            TEXTURE_SIZE, OUTPUT_SIZE);
+
+    bool first = true;
+    for(Layout &layout : layouts)
+    {
+        Texture texture;
+        if(!Texture_create(texture, source.data(), TEXTURE_SIZE, TEXTURE_SIZE, layout.layout))
+            continue;
+
+        for(int angle : angles)
+        {
+            // One texel per pixel along the row, rows one texel apart across it
+            float step = 1.0f / TEXTURE_SIZE;
+            float c = cosf(angle * 3.14159265f / 180.0f);
+            float s = sinf(angle * 3.14159265f / 180.0f);
+            float du = c * step, dv = s * step;
+            float u0 = 0.5f - (du - dv) * OUTPUT_SIZE * 0.5f;
+            float v0 = 0.5f - (dv + du) * OUTPUT_SIZE * 0.5f;
+
+            auto body = [&]()
+            {
+                for(int y = 0; y < OUTPUT_SIZE; y++)
+                {
+                    Texture_sampleRow(texture, FILTER_BILINEAR, 0.0f, u0 - dv * y, v0 + du * y,
+                                      du, dv, 0, OUTPUT_SIZE, row.data());
+                }
+            };
+
+            StageResult result = measureStage(layout.name, frames, 0, 0, body);
+            EventCounts counts = countEvents(frames, body);
+
+            fprintf(out, "%s    {\"layout\": \"%s\", \"angle\": %d, \"median_ms\": %.4f, ",
+                    first ? "" : ",\n", layout.name, angle, result.medianMs);
+            writeCount(out, "cache_misses_per_frame", counts.cacheMisses, frames);
+            fprintf(out, ", ");
+            writeCount(out, "l1d_read_misses_per_frame", counts.l1dMisses, frames);
+            fprintf(out, "}");
+            first = false;
+        }
+
+        Texture_free(texture);
+    }
+
+    fprintf(out, "\n  ]}\n");
+}
+
+static void runResolution(FILE *out, Resolution &res, int frames, bool last)
+{
+    Graphics_initializeHeadless(res.width, res.height);
+
+    std::vector<StageResult> stages;
+    double screenPixels = (double) res.width * res.height;
+
+    stages.push_back(measureStage("update", frames, 0, 1, []() { Graphics_update(); }));
+    // Same frame drawn in one pass and through the tiled worker pool
+    Jobs_initialize(1);
+    stages.push_back(measureStage("render", frames, screenPixels, 1, []() { Graphics_render(); }));
+
+    Jobs_initialize(renderThreads);
+    stages.push_back(measureStage("render_tiled", frames, screenPixels, 1, []() { Graphics_render(); }));
+
+    stages.push_back(measureStage("clear", frames, screenPixels, 1, []()
+    {
+        Graphics_clearFrameBuffer(buffer, 0xFF000000);
+    }));
+
+    stages.push_back(measureStage("grid", frames, screenPixels, 1, []()
+    {
+        Graphics_drawBackgroundGrid(buffer, 10, DOTS);
+    }));
+
+    stages.push_back(measureStage("grid_lines", frames, screenPixels, 1, []()
+    {
+        Graphics_drawBackgroundGrid(buffer, 10, LINES);
+    }));
+
+    stages.push_back(measureStage("background_grid", frames, screenPixels, 1, []()
+    {
+        Graphics_drawBackground(buffer, 0xFF000000, 10, DOTS);
+    }));
+
+    stages.push_back(measureStage("background_grid_lines", frames, screenPixels, 1, []()
+    {
+        Graphics_drawBackground(buffer, 0xFF000000, 10, LINES);
+    }));
+
+    // Fixed sets of primitives generated once per resolution
+    const int RECT_COUNT = 256;
+    const int RECT_SIZE = 64;
+    std::vector<i32> rects(RECT_COUNT * 2);
+
+    for(int i = 0; i < RECT_COUNT; i++)
+    {
+        rects[i * 2 + 0] = randomRange(0, res.width - RECT_SIZE - 1);
+        rects[i * 2 + 1] = randomRange(0, res.height - RECT_SIZE - 1);
+    }
+
+    // Rectangles are inclusive of both edges
+    double rectArea = (double)(RECT_SIZE + 1) * (RECT_SIZE + 1);
+    double rectPerimeter = 4.0 * RECT_SIZE;
+
+    stages.push_back(measureStage("rect_fill", frames, RECT_COUNT * rectArea, RECT_COUNT, [&]()
+    {
+        for(int i = 0; i < RECT_COUNT; i++)
+            Graphics_drawRectangle(buffer, rects[i * 2], rects[i * 2 + 1], RECT_SIZE, RECT_SIZE, 0xFFFF00FF, FILL);
+    }));
+
+    // Screen-sized fills, compare with memset_gb_per_s below. The inset one
+    // is written row by row instead of as a single span.
+    stages.push_back(measureStage("rect_fill_screen", frames, screenPixels, 1, [&]()
+    {
+        Graphics_drawRectangle(buffer, 0, 0, res.width - 1, res.height - 1, 0xFFFF00FF, FILL);
+    }));
+
+    stages.push_back(measureStage("rect_fill_inset", frames, (double)(res.width - 2) * (res.height - 2), 1, [&]()
+    {
+        Graphics_drawRectangle(buffer, 1, 1, res.width - 3, res.height - 3, 0xFFFF00FF, FILL);
+    }));
+
+    stages.push_back(measureStage("rect_outline", frames, RECT_COUNT * rectPerimeter, RECT_COUNT, [&]()
+    {
+        for(int i = 0; i < RECT_COUNT; i++)
+            Graphics_drawRectangle(buffer, rects[i * 2], rects[i * 2 + 1], RECT_SIZE, RECT_SIZE, 0xFFFF0000, OUTLINE);
+    }));
+
+    const int LINE_COUNT = 4096;
+    std::vector<i32> lines(LINE_COUNT * 4);
+    double linePixels = 0;
+
+    for(int i = 0; i < LINE_COUNT; i++)
+    {
+        i32 *l = &lines[i * 4];
+        l[0] = randomRange(0, res.width);
+        l[1] = randomRange(0, res.height);
+        l[2] = randomRange(0, res.width);
+        l[3] = randomRange(0, res.height);
+        linePixels += std::max(abs(l[2] - l[0]), abs(l[3] - l[1])) + 1;
+    }
+
+    stages.push_back(measureStage("line", frames, linePixels, LINE_COUNT, [&]()
+    {
+        for(int i = 0; i < LINE_COUNT; i++)
+        {
+            i32 *l = &lines[i * 4];
+            Graphics_drawLine(buffer, l[0], l[1], l[2], l[3], 0xFF00FF00);
+        }
+    }));
+
+    // Wireframe-like batch: short edges, some of them partly or fully off-screen
+    const u32 BATCH_LINE_COUNT = 1 << 20;
+    const i32 BATCH_LINE_LENGTH = 16;
+    std::vector<LineSegment> segments(BATCH_LINE_COUNT);
+    double batchPixels = 0;
+
+    for(LineSegment &segment : segments)
+    {
+        segment.x0 = randomRange(-BATCH_LINE_LENGTH * 4, res.width + BATCH_LINE_LENGTH * 4);
+        segment.y0 = randomRange(-BATCH_LINE_LENGTH * 4, res.height + BATCH_LINE_LENGTH * 4);
+        segment.x1 = segment.x0 + randomRange(-BATCH_LINE_LENGTH, BATCH_LINE_LENGTH);
+        segment.y1 = segment.y0 + randomRange(-BATCH_LINE_LENGTH, BATCH_LINE_LENGTH);
+        segment.color = 0xFF00FF00;
+        batchPixels += std::max(abs(segment.x1 - segment.x0), abs(segment.y1 - segment.y0)) + 1;
+    }
+
+    stages.push_back(measureStage("lines_batch", frames, batchPixels, BATCH_LINE_COUNT, [&]()
+    {
+        Graphics_drawLines(buffer, segments.data(), BATCH_LINE_COUNT);
+    }));
+
+    // Includes recording and binning, as a frame would pay for them
+    RenderQueue lineQueue;
+    TileBins lineBins;
+    stages.push_back(measureStage("lines_batch_tiled", frames, batchPixels, BATCH_LINE_COUNT, [&]()
+    {
+        Queue_begin(lineQueue, buffer.width, buffer.height);
+        Queue_drawLines(lineQueue, segments.data(), BATCH_LINE_COUNT);
+        Tiles_bin(lineBins, lineQueue);
+        Tiles_execute(buffer, lineQueue, lineBins);
+    }));
+
+    const int TRIANGLE_COUNT = 1024;
+    const int TRIANGLE_SIZE = 96;
+    std::vector<Vector2> triangles(TRIANGLE_COUNT * 3);
+    double trianglePixels = 0;
+
+    for(int i = 0; i < TRIANGLE_COUNT; i++)
+    {
+        Vector2 *t = &triangles[i * 3];
+        float cx = (float) randomRange(0, res.width);
+        float cy = (float) randomRange(0, res.height);
+
+        for(int k = 0; k < 3; k++)
+        {
+            t[k].x = cx + randomRange(-TRIANGLE_SIZE, TRIANGLE_SIZE);
+            t[k].y = cy + randomRange(-TRIANGLE_SIZE, TRIANGLE_SIZE);
+        }
+
+        trianglePixels += fabs((t[1].x - t[0].x) * (t[2].y - t[0].y) - (t[1].y - t[0].y) * (t[2].x - t[0].x)) * 0.5;
+    }
+
+    stages.push_back(measureStage("triangle", frames, trianglePixels, TRIANGLE_COUNT, [&]()
+    {
+        for(int i = 0; i < TRIANGLE_COUNT; i++)
+        {
+            Vector2 *t = &triangles[i * 3];
+            Graphics_drawTriangle(buffer, t[0], t[1], t[2], 0xFF3080FF);
+        }
+    }));
+
+    // Front-to-back full-screen layers, everything after the first is
+    // hidden and should be rejected by the hierarchical depth bounds
+    const int OVERDRAW_LAYERS = 16;
+
+    stages.push_back(measureStage("depth_overdraw", frames, screenPixels * OVERDRAW_LAYERS, OVERDRAW_LAYERS, [&]()
+    {
+        Graphics_clearDepthBuffer(buffer, DEPTH_FAR);
+
+        for(int i = 0; i < OVERDRAW_LAYERS; i++)
+            Graphics_drawRectangleDepth(buffer, 0, 0, res.width - 1, res.height - 1, 1.0f + i, 0xFF000000 | (i * 0x0F0F0F));
+    }));
+
+    // Synthetic image so the benchmark does not depend on ./res
+    const int IMG_SIZE = 256;
+    const int BLIT_SIZE = 320;
+    const int BLIT_COUNT = 16;
+    std::vector<u32> image(IMG_SIZE * IMG_SIZE);
+
+    for(int i = 0; i < IMG_SIZE * IMG_SIZE; i++)
+        image[i] = 0xFF000000 | nextRandom();
+
+    std::vector<i32> blits(BLIT_COUNT * 2);
+
+    for(int i = 0; i < BLIT_COUNT; i++)
+    {
+        blits[i * 2 + 0] = randomRange(0, res.width - BLIT_SIZE);
+        blits[i * 2 + 1] = randomRange(0, res.height - BLIT_SIZE);
+    }
+
+    stages.push_back(measureStage("blit", frames, (double) BLIT_COUNT * BLIT_SIZE * BLIT_SIZE, BLIT_COUNT, [&]()
+    {
+        for(int i = 0; i < BLIT_COUNT; i++)
+        {
+            Graphics_blitImageToBuffer(buffer, image.data(), IMG_SIZE, IMG_SIZE,
+                blits[i * 2], blits[i * 2 + 1], BLIT_SIZE, BLIT_SIZE, BLIT_COPY);
+        }
+    }));
+
+    // Unscaled sprites in each compositing mode against a plain row copy of the
+    // same pixels. Alpha is a mix of opaque, empty and translucent runs.
+    std::vector<u32> sprite(IMG_SIZE * IMG_SIZE);
+
+    for(int i = 0; i < IMG_SIZE * IMG_SIZE; i++)
+    {
+        u32 alphas[] = {0xFF, 0x00, 0x80, nextRandom() & 0xFF};
+        sprite[i] = (alphas[(i / 16) % 4] << 24) | (nextRandom() & 0xFFFFFF);
+    }
+
+    Graphics_premultiplyImage(sprite.data(), IMG_SIZE, IMG_SIZE);
+
+    stages.push_back(measureStage("sprite_memcpy", frames, (double) BLIT_COUNT * IMG_SIZE * IMG_SIZE, BLIT_COUNT, [&]()
+    {
+        for(int i = 0; i < BLIT_COUNT; i++)
+        {
+            for(int y = 0; y < IMG_SIZE; y++)
+            {
+                memcpy(buffer.buffer + (size_t)(blits[i * 2 + 1] + y) * buffer.width + blits[i * 2],
+                       sprite.data() + y * IMG_SIZE, IMG_SIZE * sizeof(u32));
+            }
+        }
+    }));
+
+    struct SpriteMode { const char *name; BLIT_MODE mode; };
+    SpriteMode spriteModes[] =
+    {
+        {"sprite_copy",       BLIT_COPY},
+        {"sprite_alpha_test", BLIT_ALPHA_TEST},
+        {"sprite_blend",      BLIT_BLEND},
+    };
+
+    for(SpriteMode &spriteMode : spriteModes)
+    {
+        stages.push_back(measureStage(spriteMode.name, frames, (double) BLIT_COUNT * IMG_SIZE * IMG_SIZE, BLIT_COUNT, [&]()
+        {
+            for(int i = 0; i < BLIT_COUNT; i++)
+            {
+                Graphics_blitImageToBuffer(buffer, sprite.data(), IMG_SIZE, IMG_SIZE,
+                    blits[i * 2], blits[i * 2 + 1], IMG_SIZE, IMG_SIZE, spriteMode.mode);
+            }
+        }));
+    }
+
+    // Minified blits, point sampling the full image against filtering the mip level that fits
+    const int TEXTURE_SIZE = 1024;
+    const int MINIFY_SIZE = 200;
+    std::vector<u32> textureImage(TEXTURE_SIZE * TEXTURE_SIZE);
+
+    for(int i = 0; i < TEXTURE_SIZE * TEXTURE_SIZE; i++)
+        textureImage[i] = 0xFF000000 | nextRandom();
+
+    Texture texture;
+    Texture_create(texture, textureImage.data(), TEXTURE_SIZE, TEXTURE_SIZE, LAYOUT_LINEAR);
+
+    stages.push_back(measureStage("blit_minify_point", frames, (double) BLIT_COUNT * MINIFY_SIZE * MINIFY_SIZE, BLIT_COUNT, [&]()
+    {
+        for(int i = 0; i < BLIT_COUNT; i++)
+        {
+            Graphics_blitImageToBuffer(buffer, textureImage.data(), TEXTURE_SIZE, TEXTURE_SIZE,
+                blits[i * 2], blits[i * 2 + 1], MINIFY_SIZE, MINIFY_SIZE, BLIT_COPY);
+        }
+    }));
+
+    stages.push_back(measureStage("blit_minify_bilinear", frames, (double) BLIT_COUNT * MINIFY_SIZE * MINIFY_SIZE, BLIT_COUNT, [&]()
+    {
+        for(int i = 0; i < BLIT_COUNT; i++)
+            Graphics_blitTexture(buffer, texture, blits[i * 2], blits[i * 2 + 1], MINIFY_SIZE, MINIFY_SIZE, FILTER_BILINEAR);
+    }));
+
+    stages.push_back(measureStage("blit_minify_trilinear", frames, (double) BLIT_COUNT * MINIFY_SIZE * MINIFY_SIZE, BLIT_COUNT, [&]()
+    {
+        for(int i = 0; i < BLIT_COUNT; i++)
+            Graphics_blitTexture(buffer, texture, blits[i * 2], blits[i * 2 + 1], MINIFY_SIZE, MINIFY_SIZE, FILTER_TRILINEAR);
+    }));
+
+    Texture_free(texture);
+
+    // OBJ parse of a generated grid with positions, uvs and normals, so every
+    // corner goes through vertex deduplication
+    const int MESH_GRID = 128;
+    const char *meshPath = "bench_mesh.obj";
+    FILE *meshFile = fopen(meshPath, "w");
+
+    if(meshFile)
+    {
+        for(int y = 0; y <= MESH_GRID; y++)
+        {
+            for(int x = 0; x <= MESH_GRID; x++)
+            {
+                fprintf(meshFile, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0 0 1\n",
+                        x * 0.01, y * 0.01, (float)(nextRandom() % 1000) * 0.001f,
+                        (double) x / MESH_GRID, (double) y / MESH_GRID);
+            }
+        }
+
+        for(int y = 0; y < MESH_GRID; y++)
+        {
+            for(int x = 0; x < MESH_GRID; x++)
+            {
+                int a = y * (MESH_GRID + 1) + x + 1, b = a + 1, c = a + MESH_GRID + 1, d = c + 1;
+                fprintf(meshFile, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, d, d, d, c, c, c);
+            }
+        }
+
+        fclose(meshFile);
+
+        stages.push_back(measureStage("mesh_load_obj", frames, 0, (double) MESH_GRID * MESH_GRID * 2, [&]()
+        {
+            Mesh mesh;
+            Mesh_loadOBJ(meshPath, mesh);
+            Mesh_free(mesh);
+        }));
+
+        // Same file through its binary cache, written by the first load. Pages
+        // of the mapped arrays are faulted in by whoever reads them first.
+        Mesh cached;
+        if(Mesh_load(meshPath, cached))
+        {
+            Mesh_free(cached);
+
+            stages.push_back(measureStage("mesh_load_cache", frames, 0, (double) MESH_GRID * MESH_GRID * 2, [&]()
+            {
+                Mesh mesh;
+                Mesh_load(meshPath, mesh);
+                Mesh_free(mesh);
+            }));
+        }
+
+        remove(meshPath);
+    }
+
+    // Indexed grid in front of the camera, queued one transformed triangle
+    // at a time (three transforms each) against one transform per vertex
+    const u32 DRAW_GRID = 256;
+    const u32 DRAW_TRIANGLES = DRAW_GRID * DRAW_GRID * 2;
+    VertexStream gridPositions = Vertex_createStream((DRAW_GRID + 1) * (DRAW_GRID + 1));
+    std::vector<u32> gridIndices(DRAW_TRIANGLES * 3);
+
+    for(u32 y = 0; y <= DRAW_GRID; y++)
+    {
+        for(u32 x = 0; x <= DRAW_GRID; x++)
+        {
+            u32 i = y * (DRAW_GRID + 1) + x;
+            gridPositions.x[i] = (float) x / DRAW_GRID * 2.0f - 1.0f;
+            gridPositions.y[i] = (float) y / DRAW_GRID * 2.0f - 1.0f;
+            gridPositions.z[i] = (float)(nextRandom() % 1000) * 0.0001f;
+        }
+    }
+
+    gridPositions.count = (DRAW_GRID + 1) * (DRAW_GRID + 1);
+
+    for(u32 y = 0, t = 0; y < DRAW_GRID; y++)
+    {
+        for(u32 x = 0; x < DRAW_GRID; x++, t += 6)
+        {
+            u32 a = y * (DRAW_GRID + 1) + x, b = a + 1, c = a + DRAW_GRID + 1, d = c + 1;
+            u32 corners[6] = {a, b, d, a, d, c};
+            memcpy(&gridIndices[t], corners, sizeof(corners));
+        }
+    }
+
+    Matrix4 gridMatrix = Math_multiply(Math_screenProjection(res.height * 0.5f, res.width * 0.5f, res.height * 0.5f),
+                                       Math_translation(0, 0, 1.5f));
+    ClipVolume gridVolume = Clip_screenVolume((float) res.width, (float) res.height, 0.0f, CLIP_NEAR);
+    ClipVertexBuffer gridVertices = Clip_createVertexBuffer(gridPositions.count);
+    RenderQueue gridQueue;
+
+    stages.push_back(measureStage("mesh_draw_triangles", frames, 0, DRAW_TRIANGLES, [&]()
+    {
+        Queue_begin(gridQueue, buffer.width, buffer.height);
+        for(u32 t = 0; t < DRAW_TRIANGLES; t++)
+        {
+            const u32 *corner = &gridIndices[t * 3];
+            Clip_drawTriangle(gridQueue, gridVolume, gridMatrix,
+                              {gridPositions.x[corner[0]], gridPositions.y[corner[0]], gridPositions.z[corner[0]]},
+                              {gridPositions.x[corner[1]], gridPositions.y[corner[1]], gridPositions.z[corner[1]]},
+                              {gridPositions.x[corner[2]], gridPositions.y[corner[2]], gridPositions.z[corner[2]]}, 0xFF406080);
+        }
+    }));
+
+    stages.push_back(measureStage("mesh_draw_indexed", frames, 0, DRAW_TRIANGLES, [&]()
+    {
+        Queue_begin(gridQueue, buffer.width, buffer.height);
+        Clip_transformVertices(gridVolume, gridPositions, gridMatrix, gridVertices);
+        Clip_drawIndexed(gridQueue, gridVolume, gridVertices, gridIndices.data(), DRAW_TRIANGLES, 0xFF406080);
+    }));
+
+    Clip_destroyVertexBuffer(gridVertices);
+    Vertex_destroyStream(gridPositions);
+
+    // Closed sphere drawn and rasterized with and without backface culling,
+    // front faces wind counter-clockwise on screen
+    const u32 SPHERE_RINGS = 128;
+    const u32 SPHERE_SEGMENTS = 256;
+    const u32 SPHERE_TRIANGLES = SPHERE_RINGS * SPHERE_SEGMENTS * 2;
+    VertexStream spherePositions = Vertex_createStream((SPHERE_RINGS + 1) * SPHERE_SEGMENTS);
+    std::vector<u32> sphereIndices;
+    sphereIndices.reserve(SPHERE_TRIANGLES * 3);
+
+    for(u32 r = 0; r <= SPHERE_RINGS; r++)
+    {
+        for(u32 s = 0; s < SPHERE_SEGMENTS; s++)
+        {
+            float theta = 3.14159265f * r / SPHERE_RINGS;
+            float phi = 6.28318531f * s / SPHERE_SEGMENTS;
+            u32 i = r * SPHERE_SEGMENTS + s;
+            spherePositions.x[i] = sinf(theta) * cosf(phi);
+            spherePositions.y[i] = cosf(theta);
+            spherePositions.z[i] = sinf(theta) * sinf(phi);
+        }
+    }
+
+    spherePositions.count = (SPHERE_RINGS + 1) * SPHERE_SEGMENTS;
+
+    for(u32 r = 0; r < SPHERE_RINGS; r++)
+    {
+        for(u32 s = 0; s < SPHERE_SEGMENTS; s++)
+        {
+            u32 a = r * SPHERE_SEGMENTS + s, b = r * SPHERE_SEGMENTS + (s + 1) % SPHERE_SEGMENTS;
+            u32 corners[6] = {a, b, b + SPHERE_SEGMENTS, a, b + SPHERE_SEGMENTS, a + SPHERE_SEGMENTS};
+            sphereIndices.insert(sphereIndices.end(), corners, corners + 6);
+        }
+    }
+
+    Matrix4 sphereMatrix = Math_multiply(Math_screenProjection((float) res.height, res.width * 0.5f, res.height * 0.5f),
+                                         Math_translation(0, 0, 3.0f));
+    ClipVertexBuffer sphereVertices = Clip_createVertexBuffer(spherePositions.count);
+    RenderQueue sphereQueue;
+
+    for(CULL_MODE cull : {CULL_NONE, CULL_BACK})
+    {
+        stages.push_back(measureStage(cull == CULL_NONE ? "mesh_sphere" : "mesh_sphere_culled", frames, screenPixels, SPHERE_TRIANGLES, [&]()
+        {
+            Queue_begin(sphereQueue, buffer.width, buffer.height);
+            Queue_clear(sphereQueue, 0xFF000000);
+            Queue_clearDepth(sphereQueue, DEPTH_FAR);
+            Queue_setCull(sphereQueue, cull, WINDING_COUNTER_CLOCKWISE);
+            Clip_transformVertices(gridVolume, spherePositions, sphereMatrix, sphereVertices);
+            Clip_drawIndexed(sphereQueue, gridVolume, sphereVertices, sphereIndices.data(), SPHERE_TRIANGLES, 0xFF406080);
+            Queue_execute(buffer, sphereQueue);
+        }));
+    }
+
+    Clip_destroyVertexBuffer(sphereVertices);
+    Vertex_destroyStream(spherePositions);
+
+    // 101k-node hierarchy (1000 roots, 10 children each, 9 grandchildren
+    // per child). Sparse frames move a few random nodes, full frames every root.
+    const u32 SCENE_ROOTS = 1000;
+    const u32 SCENE_MOVES = 16;
+    SceneGraph sceneGraph;
+    std::vector<u32> sceneRoots;
+
+    for(u32 r = 0; r < SCENE_ROOTS; r++)
+    {
+        u32 root = Scene_addNode(sceneGraph, SCENE_NONE);
+        Scene_setPosition(sceneGraph, root, {(float) r, 0, 10});
+        sceneRoots.push_back(root);
+
+        for(u32 c = 0; c < 10; c++)
+        {
+            u32 child = Scene_addNode(sceneGraph, root);
+            Scene_setRotation(sceneGraph, child, {0, c * 36.0f, 0});
+
+            for(u32 g = 0; g < 9; g++)
+                Scene_setPosition(sceneGraph, Scene_addNode(sceneGraph, child), {(float) g, 1, 0});
+        }
+    }
+
+    Scene_update(sceneGraph);
+    u32 sceneNodes = (u32) sceneGraph.parent.size();
+    float sceneAngle = 0;
+
+    stages.push_back(measureStage("scene_update_sparse", frames, 0, SCENE_MOVES, [&]()
+    {
+        sceneAngle += 1.0f;
+        for(u32 i = 0; i < SCENE_MOVES; i++)
+            Scene_setRotation(sceneGraph, nextRandom() % sceneNodes, {sceneAngle, 0, 0});
+        Scene_update(sceneGraph);
+    }));
+
+    stages.push_back(measureStage("scene_update_full", frames, 0, sceneNodes, [&]()
+    {
+        sceneAngle += 1.0f;
+        for(u32 root : sceneRoots)
+            Scene_setRotation(sceneGraph, root, {0, sceneAngle, 0});
+        Scene_update(sceneGraph);
+    }));
+
+    // Clip-stage transform of a large SoA cloud, scalar reference against the
+    // dispatched kernels, then the fused cull that packs the visible points
+    const u32 PROJECT_COUNT = 1 << 20;
+    VertexStream cloud = Vertex_createStream(PROJECT_COUNT);
+    ClipVertexBuffer cloudVertices = Clip_createVertexBuffer(PROJECT_COUNT);
+    ProjectedStream projected = Vertex_createProjected(PROJECT_COUNT);
+    std::vector<u32> visible(PROJECT_COUNT);
+    cloud.count = PROJECT_COUNT;
+
+    for(u32 i = 0; i < PROJECT_COUNT; i++)
+    {
+        cloud.x[i] = randomRange(-1000, 1000) / 1000.0f;
+        cloud.y[i] = randomRange(-1000, 1000) / 1000.0f;
+        cloud.z[i] = randomRange(-1000, 1000) / 1000.0f;
+    }
+
+    ClipVolume cloudVolume = Clip_screenVolume((float) res.width, (float) res.height, 0.0f, CLIP_NEAR);
+    Matrix4 modelViewProjection = Math_multiply(Math_screenProjection(768.0f, res.width / 2.0f, res.height / 2.0f),
+                                                Math_multiply(Math_translation(0.0f, 0.0f, 5.0f), Math_rotationY(0.5f)));
+
+    stages.push_back(measureStage("transform_scalar", frames, 0, PROJECT_COUNT, [&]()
+    {
+        Clip_transformScalar(cloudVolume, cloud, modelViewProjection, cloudVertices, 0, cloud.count);
+    }));
+
+    stages.push_back(measureStage("transform", frames, 0, PROJECT_COUNT, [&]()
+    {
+        Clip_transformVertices(cloudVolume, cloud, modelViewProjection, cloudVertices);
+    }));
+
+    stages.push_back(measureStage("cull_points", frames, 0, PROJECT_COUNT, [&]()
+    {
+        Clip_cullPoints(cloudVolume, cloud, modelViewProjection, projected, visible.data());
+    }));
+
+    Vertex_destroyStream(cloud);
+    Clip_destroyVertexBuffer(cloudVertices);
+    Vertex_destroyProjected(projected);
+
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"resolution\": \"%s\", \"width\": %u, \"height\": %u, \"frames\": %d, \"threads\": %u,\n",
+            res.name, res.width, res.height, frames, Jobs_workerCount());
+    fprintf(out, "      \"stages\": [\n");
+
+    for(size_t i = 0; i < stages.size(); i++)
+        writeStage(out, stages[i], i + 1 == stages.size());
+
+    fprintf(out, "      ],\n");
+
+    writeClearKernels(out, frames);
+    fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char* argv[])
+{
+    int frames = 100;
+    const char *resName = "all";
+    const char *outPath = NULL;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--res") == 0 && i + 1 < argc)
+            resName = argv[++i];
+        else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            renderThreads = (u32) atoi(argv[++i]);
+        else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else
+        {
+            printf("Usage: %s [--frames N] [--res 720p|1080p|4k|all] [--threads N] [--out file.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(frames <= 0)
+    {
+        printf("Error: Frame count must be positive\n");
+        return 1;
+    }
+
+    std::vector<Resolution> selected;
+    for(Resolution &res : resolutions)
+    {
+        if(strcmp(resName, "all") == 0 || strcmp(resName, res.name) == 0)
+            selected.push_back(res);
+    }
+
+    if(selected.empty())
+    {
+        printf("Error: Unknown resolution: %s\n", resName);
+        return 1;
+    }
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if(out == NULL)
+    {
+        printf("Error: Failed to open file for writing: %s\n", outPath);
+        return 1;
+    }
+
+    // Scene resources are loaded once here; load failures are reported on
+    // stderr, so stdout stays valid JSON
+    Graphics_initializeHeadless(selected[0].width, selected[0].height);
+
+    fprintf(out, "{\n  \"benchmark\": \"3DRasterizer\",\n  \"results\": [\n");
+
+    for(size_t i = 0; i < selected.size(); i++)
+        runResolution(out, selected[i], frames, i + 1 == selected.size());
+
+    fprintf(out, "  ],\n");
+
+    writeTextureLayouts(out, frames);
+    fprintf(out, "}\n");
+
+    if(out != stdout)
+        fclose(out);
+
+    Graphics_shutdown();
+
+    return 0;
+}
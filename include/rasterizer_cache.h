@@ -0,0 +1,50 @@
+#pragma once
+
+// On-disk cache blobs shared by textures and meshes. A blob is keyed by its
+// source file's size and modification time, named after a hash of the
+// source path, mapped whole on load and written under a temporary name
+// that is renamed into place, so a reader never maps a partial blob.
+
+#include <stddef.h>
+#include <stdio.h>
+#include "rasterizer_graphics.h"
+
+// Arrays inside a blob start on this boundary
+const u32 CACHE_ALIGNMENT = 64;
+
+const size_t CACHE_PATH_SIZE = 1024;
+
+// Cache key of a source file. time is nanoseconds since the epoch, or
+// 100 ns FILETIME ticks on Windows.
+struct CacheSource
+{
+    u64 size;
+    i64 time;
+};
+
+// A blob being written, see Cache_beginWrite()
+struct CacheWriter
+{
+    FILE *file;
+    u64 position;
+    char filename[CACHE_PATH_SIZE];
+    char temporary[CACHE_PATH_SIZE + 32];
+};
+
+extern bool   Cache_statSource    (const char *path, CacheSource &source);
+// directory/<FNV-1a hash of path><suffix>. The full path belongs inside the
+// blob and is compared on load, so collisions only cost a rebuild.
+extern void   Cache_blobPath      (const char *directory, const char *path, const char *suffix, char *result, size_t capacity);
+
+// Maps a whole file, nullptr when it is missing or empty. copyOnWrite gives
+// a private writable view whose pages stay shared until written.
+extern void  *Cache_mapFile       (const char *filename, bool copyOnWrite, size_t &size);
+extern void   Cache_unmapFile     (const void *view, size_t size);
+
+// Opens a per-process temporary next to filename, creating directory first
+extern bool   Cache_beginWrite    (CacheWriter &writer, const char *directory, const char *filename);
+// Writes data at offset, zero padding from the current position up to it
+extern bool   Cache_write         (CacheWriter &writer, u64 offset, const void *data, size_t size);
+// Renames the temporary over the blob when everything was written,
+// removes it otherwise. Returns true when the blob is in place.
+extern bool   Cache_endWrite      (CacheWriter &writer, bool written);
@@ -0,0 +1,121 @@
+#pragma once
+
+// Frustum culling and homogeneous clipping between the vertex transform
+// and the rasterizer. Works in the clip space produced by
+// Math_screenProjection(): x/w and y/w are pixels and w is view depth, so
+// nothing is divided until it is known to lie in front of the near plane.
+
+#include "rasterizer_graphics.h"
+#include "rasterizer_math.h"
+#include "rasterizer_vertex.h"
+#include "rasterizer_tiles.h"
+
+const float CLIP_NEAR = 0.1f;
+
+// A triangle clipped by five planes gains at most five vertices
+const u32 CLIP_MAX_VERTICES = 8;
+
+enum CLIP_PLANE
+{
+    CLIP_PLANE_NEAR   = 1 << 0,
+    CLIP_PLANE_LEFT   = 1 << 1,
+    CLIP_PLANE_RIGHT  = 1 << 2,
+    CLIP_PLANE_TOP    = 1 << 3,
+    CLIP_PLANE_BOTTOM = 1 << 4
+};
+
+// Visible region in pixels (inclusive) and the near plane in view depth
+struct ClipVolume
+{
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+    float zNear;
+};
+
+// Per-frame counters, reset by Clip_resetStats()
+struct ClipStats
+{
+    u32 pointsVisible;
+    u32 pointsCulled;
+    u32 boundsCulled;
+    u32 linesCulled;
+    u32 linesClipped;
+    u32 trianglesCulled;
+    u32 trianglesClipped;
+
+    // Rejected by triangle setup after projection
+    u32 trianglesBackfacing;
+    u32 trianglesDegenerate;    // Zero area once snapped
+    u32 trianglesEmpty;         // Covers no pixel centre
+
+    // Indexed draws: vertices through the transform against corners read
+    u32 verticesTransformed;
+    u32 indicesProcessed;
+    u32 trianglesInvalid;       // Skipped for an index past the buffer
+};
+
+// Post-transform vertex buffer for indexed draws. Every vertex is
+// transformed once into clip space with its outcode; vertices in front of
+// the near plane also get their divided screen position, so triangles that
+// need no clipping are assembled from the buffer without any arithmetic.
+struct ClipVertexBuffer
+{
+    float *x;
+    float *y;
+    float *z;
+    float *w;
+    float *screenX;     // x / w, only meaningful without CLIP_PLANE_NEAR
+    float *screenY;     // y / w
+    u8 *outcodes;
+    u32 count;
+    u32 capacity;
+};
+
+extern ClipStats clipStats;
+
+extern void         Clip_resetStats         ();
+
+// Screen rectangle grown by margin pixels on every side
+extern ClipVolume   Clip_screenVolume       (float width, float height, float margin, float zNear);
+
+// Bit set for every plane the point lies outside of, 0 when inside
+extern u32          Clip_outcode            (const ClipVolume &volume, Vector4 clip);
+
+// True when the box [min, max] is entirely outside one plane
+extern bool         Clip_cullBounds         (const ClipVolume &volume, const Matrix4 &matrix, Vector3 min, Vector3 max);
+
+// Clips the segment in place, false when nothing of it is visible
+extern bool         Clip_line               (const ClipVolume &volume, Vector4 &a, Vector4 &b);
+
+// Clips a triangle to a convex polygon (drawn as a fan), returns its vertex
+// count or 0 when culled. Side planes are only clipped when a vertex would
+// otherwise land outside the rasterizer's guard band.
+extern u32          Clip_triangle           (const ClipVolume &volume, const Vector4 in[3], Vector4 out[CLIP_MAX_VERTICES]);
+
+// Transforms, culls and projects points in one pass. Survivors are packed
+// at the front of out (out.count of them) and indices[i] is the source
+// vertex of out[i].
+extern u32          Clip_cullPoints         (const ClipVolume &volume, VertexStream &in, const Matrix4 &matrix, ProjectedStream &out, u32 *indices);
+
+extern ClipVertexBuffer Clip_createVertexBuffer  (u32 capacity);
+extern void             Clip_destroyVertexBuffer (ClipVertexBuffer &buffer);
+
+// Transforms in[0, in.count) into out, split across the worker pool for
+// large streams. The count is clamped to out.capacity. Every SIMD level matches Math_transform() exactly.
+extern void         Clip_transformVertices  (const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out);
+
+extern void         Clip_transformScalar    (const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end);
+extern void         Clip_transformSSE2      (const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end);
+extern void         Clip_transformAVX2      (const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end);
+
+// Queues triangleCount triangles, 3 indices each, from a transformed
+// buffer. Output matches Clip_drawTriangle() on the same corners.
+// Triangles indexing at or past vertices.count are skipped.
+extern void         Clip_drawIndexed        (RenderQueue &queue, const ClipVolume &volume, const ClipVertexBuffer &vertices,
+                                             const u32 *indices, u32 triangleCount, u32 color);
+
+// World-space primitives clipped and queued for rasterization
+extern void         Clip_drawLine           (RenderQueue &queue, const ClipVolume &volume, const Matrix4 &matrix, Vector3 a, Vector3 b, u32 color);
+extern void         Clip_drawTriangle       (RenderQueue &queue, const ClipVolume &volume, const Matrix4 &matrix, Vector3 v0, Vector3 v1, Vector3 v2, u32 color);
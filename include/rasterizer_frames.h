@@ -0,0 +1,31 @@
+#pragma once
+
+// Triple-buffered frames handed from the render thread to the presenting
+// thread. Each side owns one FrameBuffer and the third waits in a single
+// atomic word, so publishing and acquiring are one exchange each and the
+// presenter never blocks. The renderer waits for its last frame to be
+// picked up before drawing on, so it runs at the presenter's pace one
+// frame ahead, and the presenter only ever sees whole frames.
+
+#include "rasterizer_graphics.h"
+
+const u32 FRAME_SLOTS = 3;
+
+// Allocates the slots, which share one depth buffer: depth is only used
+// while drawing, and only the render thread draws
+extern void          Frames_initialize   (u32 width, u32 height);
+extern void          Frames_shutdown     ();
+
+// Render side: the frame to draw into, and handing it over when it's done.
+// Publish returns the next frame to draw into.
+extern FrameBuffer&  Frames_back         ();
+extern FrameBuffer&  Frames_publish      ();
+// Blocks until the presenter has acquired the last published frame, or
+// until Frames_stop()
+extern void          Frames_waitConsumed ();
+// Releases the render side from waiting, for shutdown
+extern void          Frames_stop         ();
+
+// Present side: the newest finished frame, nullptr when none arrived
+// since the last call. Stays valid until the next call.
+extern FrameBuffer*  Frames_acquire      ();
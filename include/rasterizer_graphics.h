@@ -6,14 +6,49 @@
 #define u8  uint8_t
 #define u32 uint32_t
 #define i32 int32_t
+#define i64 int64_t
+#define u64 uint64_t
 #define globalVariable static
 
 
+// Depth values are "smaller is closer". Besides the per-pixel values the
+// buffer keeps min/max per 8x8 block and max per 64x64 tile, so hidden
+// parts of a primitive can be rejected before any per-pixel work.
+const u32 DEPTH_BLOCK_SIZE = 8;
+const u32 DEPTH_TILE_SIZE  = 64;
+const float DEPTH_FAR      = 3.402823466e+38f;
+
+// Fixed simulation steps per second, independent of the frame rate
+const double SIMULATION_RATE = 120.0;
+
+struct DepthBuffer
+{
+    float *depth;
+    float *blockMin;
+    float *blockMax;
+    float *tileMax;
+    u32 blocksX;
+    u32 blocksY;
+    u32 tilesX;
+    u32 tilesY;
+};
+
 struct FrameBuffer
 {
     u32 *buffer;
     u32 width;
     u32 height;
+    DepthBuffer *depth; // Optional, nullptr without depth testing
+};
+
+// One segment of a Graphics_drawLines() batch, endpoints inclusive
+struct LineSegment
+{
+    i32 x0;
+    i32 y0;
+    i32 x1;
+    i32 y1;
+    u32 color;
 };
 
 enum GRID_MODE
@@ -28,6 +63,23 @@ enum RECT_MODE
     FILL
 };
 
+// How blitted image pixels combine with the frame
+enum BLIT_MODE
+{
+    BLIT_COPY,          // Overwrite
+    BLIT_ALPHA_TEST,    // Overwrite where alpha >= 128
+    BLIT_BLEND          // Premultiplied alpha over, see Graphics_premultiplyImage
+};
+
+// How finished frames reach the window, chosen when the window surface is created
+enum PRESENT_MODE
+{
+    PRESENT_DIRECT,     // The FrameBuffer is the surface's pixels, nothing is copied
+    PRESENT_COPY,       // Same format, rows are copied to honour the surface pitch
+    PRESENT_SWIZZLE,    // 32-bit BGR surface, red and blue swapped while copying
+    PRESENT_CONVERT     // Any other format, converted by SDL
+};
+
 enum PROJECTION_MODE
 {
     ORTHOGRAPHIC,
@@ -38,27 +90,49 @@ struct SDL_Window;
 struct SDL_Surface;
 struct Vector2;
 struct Vector3;
+struct FramePacer;
 
 extern int windowWidth; // Declare global variables with extern
 extern int windowHeight;
 extern SDL_Window* window;
 extern bool quit;
 extern FrameBuffer buffer;
+extern u32 renderThreads;
+extern PRESENT_MODE presentMode;
+extern bool pipelineFrames; // Render on its own thread, cleared at init with a single worker
+extern u32 targetFrameRate; // 0 follows the display refresh rate
+extern double simulationTime;
 
 
 extern int          Graphics_loadImage                (const char *filename, u32 **pixels, int *width, int *height);
 extern void         Graphics_setPixel                 (FrameBuffer buffer, i32 x, i32 y, u32 color);
 extern FrameBuffer  Graphics_createColorBuffer        (u32 w, u32 h);
+extern void         Graphics_destroyColorBuffer       (FrameBuffer &buffer);
+extern void         Graphics_createDepthBuffer        (FrameBuffer &buffer);
+extern void         Graphics_clearDepthBuffer         (FrameBuffer &buffer, float depth);
 extern void         Graphics_clearFrameBuffer         (FrameBuffer &buffer, u32 color);
 extern void         Graphics_drawLine                 (FrameBuffer buffer, i32 x0, i32 y0, i32 x1, i32 y1, u32 color);
+extern void         Graphics_drawLines                (FrameBuffer &buffer, const LineSegment *lines, u32 count);
 extern void         Graphics_drawBackgroundGrid       (FrameBuffer &buffer, i32 step, GRID_MODE mode);
+extern void         Graphics_drawBackground           (FrameBuffer &buffer, u32 color, i32 step, GRID_MODE mode);
 extern void         Graphics_drawRectangle            (FrameBuffer &buffer, i32 x0, i32 y0, i32 w, i32 h, u32 color, RECT_MODE mode);
+extern void         Graphics_drawTriangle             (FrameBuffer &buffer, Vector2 v0, Vector2 v1, Vector2 v2, u32 color);
+extern void         Graphics_drawRectangleDepth       (FrameBuffer &buffer, i32 x0, i32 y0, i32 w, i32 h, float depth, u32 color);
+extern void         Graphics_drawTriangleDepth        (FrameBuffer &buffer, Vector3 v0, Vector3 v1, Vector3 v2, u32 color);
 extern void         Graphics_blitColorBufferToWindow  (SDL_Window *window, SDL_Surface *windowSurface, FrameBuffer &buffer);
-extern void         Graphics_blitImageToBuffer        (FrameBuffer &buffer, u32 *imgPixels, int imgW, int imgH, int x, int y, int w, int h);
+extern void         Graphics_blitImageToBuffer        (FrameBuffer &buffer, u32 *imgPixels, int imgW, int imgH, int x, int y, int w, int h, BLIT_MODE mode);
+extern void         Graphics_premultiplyImage         (u32 *pixels, int width, int height);
 extern void         Graphics_initializeWindow();
+extern void         Graphics_initializeHeadless       (u32 w, u32 h);
+extern void         Graphics_initializeScene();
+extern void         Graphics_shutdown();
+extern int          Graphics_writeFrameBufferPPM      (const char *filename, FrameBuffer &buffer);
 extern void         Graphics_processInput();
+extern void         Graphics_simulate(double seconds);
 extern void         Graphics_update();
 extern void         Graphics_render();
+extern void         Graphics_present();
+extern void         Graphics_runPipelined(FramePacer &pacer);
 
 // Naive 3D Virtual World to Screen Space Projection
 extern Vector2         Graphics_project     (Vector3 point, PROJECTION_MODE mode);
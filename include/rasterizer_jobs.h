@@ -0,0 +1,17 @@
+#pragma once
+
+// Persistent worker pool for data-parallel loops. Each worker owns a
+// contiguous range of task indices and pops from its front; idle workers
+// steal the back half of the busiest-looking range. The calling thread
+// takes part as worker 0.
+
+#include "rasterizer_graphics.h"
+
+typedef void (*JobFunction)(void *context, u32 index, u32 worker);
+
+extern void   Jobs_initialize     (u32 threadCount);
+extern void   Jobs_shutdown();           // Must run before exit, workers block static destruction
+extern u32    Jobs_workerCount();
+
+// Runs function(context, i, worker) for i in [0, count), returns when all are done
+extern void   Jobs_parallelFor    (u32 count, JobFunction function, void *context);
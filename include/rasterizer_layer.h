@@ -0,0 +1,41 @@
+#pragma once
+
+// Persistent layers rendered once and copied into the frame. A cleared
+// background with its grid is periodic in y, so the layer keeps one opaque
+// pattern row for grid rows and one for the rows between them. Drawing it
+// copies an L1-resident pattern into every row, which replaces both the
+// clear and the grid pass.
+
+#include "rasterizer_graphics.h"
+#include "rasterizer_raster.h"
+
+// Distinct backgrounds kept alive at once. Queued commands hold layer
+// pointers, so layers they use are pinned until the next Layer_beginFrame()
+// and a frame past this many different ones falls back to uncached draws.
+const u32 LAYER_GRID_CACHE_SIZE = 4;
+
+struct GridLayer
+{
+    // Cache key, the layer is rebuilt when any of these change
+    i32 step;
+    GRID_MODE mode;
+    u32 background;
+    u32 width;
+    u32 height;
+
+    // Two 64-byte aligned rows: y % step == 0, then every other row
+    u32 *pixels;
+
+    u64 lastUse;
+    // Held by a queued command, never evicted
+    bool pinned;
+};
+
+// Cached layer for the key, built on a miss. pin keeps it alive until the
+// next Layer_beginFrame(). nullptr when step <= 0 or every slot is pinned.
+// Not thread safe, call while recording the frame.
+extern GridLayer*   Layer_grid                (i32 step, GRID_MODE mode, u32 background, u32 width, u32 height, bool pin);
+// Unpins every layer, the previous frame's commands must have executed
+extern void         Layer_beginFrame          ();
+extern void         Layer_drawGrid            (FrameBuffer &buffer, const GridLayer &layer, RasterRect clip);
+extern void         Layer_shutdown            ();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 struct Vector2
 {
   float x;
@@ -25,3 +27,58 @@ struct Camera
   float fovAngle;   // Angle opening of the camera (field of view)
 };
 
+
+
+struct alignas(16) Vector4
+{
+  float x;
+  float y;
+  float z;
+  float w;
+
+};
+
+
+// Column-major (m[column][row]) acting on column vectors, so
+// Math_multiply(a, b) applies b first and each column loads as one SSE register
+struct alignas(16) Matrix4
+{
+  float m[4][4];
+
+};
+
+
+extern Matrix4  Math_identity           ();
+extern Matrix4  Math_translation        (float x, float y, float z);
+extern Matrix4  Math_scale              (float x, float y, float z);
+extern Matrix4  Math_rotationX          (float radians);
+extern Matrix4  Math_rotationY          (float radians);
+extern Matrix4  Math_rotationZ          (float radians);
+
+// Euler angles in degrees, applied Z then X then Y (same units as Camera::rotation)
+extern Matrix4  Math_rotationEuler      (Vector3 degrees);
+
+// Model matrix from position, Euler rotation in degrees and scale
+extern Matrix4  Math_model              (Vector3 position, Vector3 rotation, Vector3 scale);
+
+// Right-handed view looking down +z, the rasterizer's camera convention
+extern Matrix4  Math_lookAt             (Vector3 eye, Vector3 target, Vector3 up);
+extern Matrix4  Math_view               (Camera &camera);
+
+// Clip-space projections, z/w maps near..far to 0..1
+extern Matrix4  Math_perspective        (float fovY, float aspect, float zNear, float zFar);
+extern Matrix4  Math_orthographic       (float left, float right, float bottom, float top, float zNear, float zFar);
+
+// Projection fused with the viewport, x/w and y/w are pixels and z is view depth.
+// Same mapping as Graphics_project(PERSPECTIVE) plus the screen-centre offset.
+extern Matrix4  Math_screenProjection   (float fovFactor, float centerX, float centerY);
+
+extern Matrix4  Math_multiply           (const Matrix4 &a, const Matrix4 &b);
+extern Matrix4  Math_transpose          (const Matrix4 &matrix);
+extern Vector4  Math_transform          (const Matrix4 &matrix, Vector4 v);
+
+// General inverse, returns false (and leaves result untouched) when singular
+extern bool     Math_inverse            (const Matrix4 &matrix, Matrix4 &result);
+
+// matrix * in[i] for count vectors, in and out may alias
+extern void     Math_transformBatch     (const Matrix4 &matrix, const Vector4 *in, Vector4 *out, size_t count);
@@ -0,0 +1,103 @@
+#pragma once
+
+// Triangle meshes. Vertices are the distinct position / uv / normal
+// combinations the faces use; positions live in a VertexStream so they go
+// through the batched transform kernels, and triangles index them.
+//
+// OBJ files are mapped and parsed in parallel chunks of whole lines. A
+// counting pass sizes every chunk's statements first, so the parsing pass
+// writes straight into the final arrays and resolves relative indices
+// without a merge step.
+//
+// Loaded meshes are written to a binary cache blob keyed like texture
+// blobs. Each array sits 64-byte aligned in the blob, so a later load maps
+// it and points the mesh at those arrays without parsing anything.
+
+#include "rasterizer_vertex.h"
+#include "rasterizer_cache.h"
+
+// OBJ text per parse task
+const size_t MESH_CHUNK_SIZE = 1 << 20;
+
+// Missing uv or normal of a face corner
+const u32 MESH_NONE = 0xFFFFFFFF;
+
+const u32 MESH_CACHE_MAGIC     = 0x48534D52; // "RMSH"
+const u32 MESH_CACHE_VERSION   = 2;
+const u32 MESH_CACHE_ALIGNMENT = 64;
+
+// MeshCacheHeader::flags
+const u32 MESH_CACHE_NORMALS = 1 << 0;
+const u32 MESH_CACHE_UVS     = 1 << 1;
+
+enum MESH_STORAGE
+{
+    MESH_OWNED,     // Separate aligned arrays
+    MESH_MAPPED     // Copy-on-write view of a cache blob
+};
+
+struct Mesh
+{
+    VertexStream positions;
+    float *normals;     // 3 per vertex, nullptr when the file has none
+    float *uvs;         // 2 per vertex, nullptr when the file has none
+    u32 vertexCount;
+
+    u32 *indices;       // 3 per triangle
+    u32 triangleCount;
+
+    // Axis-aligned box and a sphere around its centre holding every vertex
+    Vector3 boundsMin;
+    Vector3 boundsMax;
+    Vector3 center;
+    float radius;
+
+    MESH_STORAGE storage;
+    void *mapping;
+    size_t mappingSize;
+};
+
+// Fixed part of a cache blob, followed by the source path and the arrays at
+// the given offsets from the start of the blob
+struct MeshCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 sourceSize;
+    i64 sourceTime;
+    u32 vertexCount;
+    u32 triangleCount;
+    u32 flags;
+    u32 pathLength;
+
+    float boundsMin[3];
+    float boundsMax[3];
+    float center[3];
+    float radius;
+
+    u64 xOffset;
+    u64 yOffset;
+    u64 zOffset;
+    u64 normalOffset;   // 0 without MESH_CACHE_NORMALS
+    u64 uvOffset;       // 0 without MESH_CACHE_UVS
+    u64 indexOffset;
+    u64 size;
+};
+
+// Where blobs are written, created on first use
+extern const char  *meshCacheDirectory;
+
+// Polygons are split into fans, statements other than v, vt, vn and f are
+// skipped. Returns false with a message when the file can't be mapped or
+// a face refers to a missing vertex.
+extern bool   Mesh_loadOBJ        (const char *path, Mesh &mesh);
+// Maps the cache blob when it matches the file, otherwise parses the OBJ
+// and writes one. Returns false quietly when the file doesn't exist.
+extern bool   Mesh_load           (const char *path, Mesh &mesh);
+extern void   Mesh_free           (Mesh &mesh);
+
+// Writes the blob for path keyed by source as stat'ed before parsing, true on success
+extern bool   Mesh_storeCache     (const char *path, CacheSource source, const Mesh &mesh);
+
+// Fills the bounding box and sphere from the vertex positions
+extern void   Mesh_computeBounds  (Mesh &mesh);
@@ -0,0 +1,56 @@
+#pragma once
+
+// Frame pacing with a fixed-step simulation. A pacer gives every frame a
+// deadline one period after the previous one and waits for it by sleeping
+// in 1 ms slices while that is safe, then yielding until the deadline.
+// How long a 1 ms sleep really takes is measured as it runs, so coarse OS
+// timers make the pacer yield longer instead of missing deadlines.
+//
+// Simulation time is accumulated from real time and consumed in fixed
+// steps, so the simulation advances the same way at any frame rate.
+
+#include "rasterizer_graphics.h"
+
+// Steps run in one frame at most, time beyond that is dropped rather than
+// letting a slow frame schedule ever more steps
+const u32 PACING_MAX_STEPS = 8;
+
+// Intervals between frame starts since initialization
+struct FrameStats
+{
+    u32 frames;
+    u32 missed;         // Frames that finished after their deadline
+    double meanMs;
+    double jitterMs;    // Standard deviation of the interval
+    double maxMs;
+};
+
+struct FramePacer
+{
+    u64 periodNs;       // 0 runs unpaced
+    u64 stepNs;
+    u64 deadline;
+    u64 frameStart;
+    u64 accumulator;
+
+    // Measured length of a 1 ms sleep, running mean and variance
+    u32 sleeps;
+    double sleepMean;
+    double sleepM2;
+
+    u32 intervals;
+    u32 missed;
+    double intervalMean;
+    double intervalM2;
+    double intervalMax;
+};
+
+// frameRate 0 leaves frames unpaced
+extern void         Pacing_initialize         (FramePacer &pacer, double frameRate, double simulationRate);
+// Returns the simulation steps due this frame
+extern u32          Pacing_beginFrame         (FramePacer &pacer);
+// Waits until the frame's deadline
+extern void         Pacing_endFrame           (FramePacer &pacer);
+extern double       Pacing_stepSeconds        (const FramePacer &pacer);
+extern FrameStats   Pacing_stats              (const FramePacer &pacer);
+extern u64          Pacing_nowNs();
@@ -0,0 +1,92 @@
+#pragma once
+
+// Half-space triangle rasterization. Vertices are snapped to a 28.4
+// fixed-point grid and edge functions are evaluated exactly in integer
+// math, so coverage does not depend on traversal order or clip rect.
+//
+// Setup rejects triangles that would draw nothing: zero area after
+// snapping, no pixel centre inside their bounds, or facing the culled way.
+
+#include "rasterizer_graphics.h"
+#include "rasterizer_math.h"
+#include "rasterizer_texture.h"
+
+const i32 RASTER_SUBPIXEL_BITS = 4;
+const i32 RASTER_SUBPIXEL_ONE  = 1 << RASTER_SUBPIXEL_BITS;
+
+// Vertices beyond this many pixels are rejected, keeping the per-pixel
+// edge steps small enough for the 32-bit SIMD lanes
+const float RASTER_GUARD_BAND = 131072.0f;
+
+enum CULL_MODE
+{
+    CULL_NONE,
+    CULL_BACK,
+    CULL_FRONT
+};
+
+// Winding of front faces as seen on screen, y pointing down
+enum WINDING
+{
+    WINDING_CLOCKWISE,
+    WINDING_COUNTER_CLOCKWISE
+};
+
+struct RasterCull
+{
+    CULL_MODE mode;
+    WINDING frontFace;
+};
+
+// Pixel rectangle, max is exclusive
+struct RasterRect
+{
+    i32 minX;
+    i32 minY;
+    i32 maxX;
+    i32 maxY;
+};
+
+struct TriangleSetup
+{
+    // Edge i at pixel (x, y): origin[i] + stepX[i] * x + stepY[i] * y.
+    // Sampled at pixel centres with the top-left bias folded into origin,
+    // a pixel is covered when all three are >= 0
+    i64 origin[3];
+    i64 stepX[3];
+    i64 stepY[3];
+
+    // Depth plane at pixel (x, y): zOrigin + zStepX * x + zStepY * y
+    bool depthTest;
+    float zOrigin;
+    float zStepX;
+    float zStepY;
+    float zMin;
+    float zMax;
+
+    // Conservative pixel bounds of the triangle
+    RasterRect bounds;
+};
+
+// False when the triangle is rejected, counted in clipStats
+extern bool         Raster_setupTriangle      (TriangleSetup &setup, Vector2 v0, Vector2 v1, Vector2 v2, RasterCull cull);
+extern bool         Raster_setupTriangleDepth (TriangleSetup &setup, Vector3 v0, Vector3 v1, Vector3 v2, RasterCull cull);
+extern void         Raster_setupRectangle     (TriangleSetup &setup, RasterRect rect, float depth);
+extern void         Raster_fillTriangle       (FrameBuffer &buffer, TriangleSetup &setup, RasterRect clip, u32 color);
+extern RasterRect   Raster_intersectRect      (RasterRect a, RasterRect b);
+
+// Depth buffer maintenance, clip is in pixels
+extern void         Raster_clearDepth         (FrameBuffer &buffer, RasterRect clip, float depth);
+extern void         Raster_updateDepthBlock   (DepthBuffer &depth, FrameBuffer &buffer, u32 blockX, u32 blockY);
+extern void         Raster_updateDepthTile    (DepthBuffer &depth, u32 tileX, u32 tileY);
+
+// Clipped 2D primitives shared by the immediate and tiled paths
+extern void         Raster_fillRect           (FrameBuffer &buffer, RasterRect rect, RasterRect clip, u32 color);
+extern void         Raster_outlineRect        (FrameBuffer &buffer, RasterRect rect, RasterRect clip, u32 color);
+extern void         Raster_grid               (FrameBuffer &buffer, i32 step, GRID_MODE mode, RasterRect clip);
+extern void         Raster_line               (FrameBuffer &buffer, i32 x0, i32 y0, i32 x1, i32 y1, RasterRect clip, u32 color);
+extern void         Raster_lines              (FrameBuffer &buffer, const LineSegment *lines, u32 count, RasterRect clip);
+extern RasterRect   Raster_lineBounds         (i32 x0, i32 y0, i32 x1, i32 y1);
+extern RasterRect   Raster_blitRect           (FrameBuffer &buffer, int x, int y, int w, int h);
+extern void         Raster_blit               (FrameBuffer &buffer, u32 *imgPixels, int imgW, int imgH, int x, int y, int w, int h, BLIT_MODE mode, RasterRect clip);
+extern void         Raster_blitTexture        (FrameBuffer &buffer, const Texture &texture, int x, int y, int w, int h, TEXTURE_FILTER filter, RasterRect clip);
@@ -0,0 +1,60 @@
+#pragma once
+
+// Transform hierarchy. Nodes are indices into parallel arrays, so a
+// node's position, rotation, scale and cached matrices each sit in their
+// own contiguous array and children are linked by index, not by pointer.
+//
+// Setting a node's transform only flags it. Scene_update() then rebuilds
+// the local matrix of every flagged node and the world matrices of its
+// subtree, so a frame where a few nodes move costs those subtrees and
+// nothing else.
+
+#include <vector>
+
+#include "rasterizer_graphics.h"
+#include "rasterizer_math.h"
+
+// No parent, child or sibling
+const u32 SCENE_NONE = 0xFFFFFFFF;
+
+// SceneGraph::flags
+const u8 SCENE_DIRTY = 1 << 0;  // Local transform changed, node is in the dirty list
+
+struct SceneGraph
+{
+    // Per node. A parent is always added before its children, so its
+    // index is lower.
+    std::vector<u32> parent;
+    std::vector<u32> firstChild;
+    std::vector<u32> nextSibling;
+
+    // Local transform, rotation in Euler degrees like Math_model()
+    std::vector<Vector3> position;
+    std::vector<Vector3> rotation;
+    std::vector<Vector3> scale;
+
+    std::vector<Matrix4> local;
+    std::vector<Matrix4> world;
+    std::vector<u8> flags;
+
+    // Nodes flagged since the last update, each once
+    std::vector<u32> dirty;
+    std::vector<u32> stack;
+
+    // World matrices rebuilt by the last update
+    u32 updated;
+};
+
+// New node with an identity transform under parent, or a root with SCENE_NONE
+extern u32            Scene_addNode       (SceneGraph &scene, u32 parent);
+extern void           Scene_clear         (SceneGraph &scene);
+
+extern void           Scene_setPosition   (SceneGraph &scene, u32 node, Vector3 position);
+extern void           Scene_setRotation   (SceneGraph &scene, u32 node, Vector3 degrees);
+extern void           Scene_setScale      (SceneGraph &scene, u32 node, Vector3 scale);
+
+// Brings every world matrix up to date
+extern void           Scene_update        (SceneGraph &scene);
+
+// Valid after Scene_update()
+extern const Matrix4& Scene_world         (const SceneGraph &scene, u32 node);
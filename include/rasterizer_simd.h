@@ -0,0 +1,51 @@
+#pragma once
+
+// SIMD kernels with runtime CPU dispatch. Each kernel has a scalar
+// reference version; wider versions are compiled per-function for their
+// instruction set and selected by Simd_initialize() from CPUID.
+
+#include <stddef.h>
+#include "rasterizer_graphics.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#endif
+
+#if defined(_MSC_VER)
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+enum SIMD_LEVEL
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+struct CpuFeatures
+{
+    bool sse2;
+    bool sse41;
+    bool avx2;
+    bool fma;
+    bool avx512f;
+};
+
+typedef void (*ClearFunction)(u32 *dst, size_t count, u32 value);
+
+extern CpuFeatures   cpuFeatures;
+extern SIMD_LEVEL    simdLevel;
+extern ClearFunction Simd_clear;
+
+extern void         Simd_initialize();
+extern void         Simd_setLevel       (SIMD_LEVEL level);
+extern const char  *Simd_levelName      (SIMD_LEVEL level);
+
+// Full-buffer clears, wide versions use non-temporal (streaming) stores
+extern void         Simd_clearScalar    (u32 *dst, size_t count, u32 value);
+extern void         Simd_clearSSE2      (u32 *dst, size_t count, u32 value);
+extern void         Simd_clearAVX2      (u32 *dst, size_t count, u32 value);
+extern void         Simd_clearAVX512    (u32 *dst, size_t count, u32 value);
@@ -0,0 +1,59 @@
+#pragma once
+
+// Horizontal span kernels under the 2D primitives. Primitives are clipped
+// once, then every row they cover is written as one run with vector
+// stores; nothing in here bounds-checks individual pixels.
+
+#include <stddef.h>
+#include "rasterizer_graphics.h"
+
+// Runs at least this long bypass the cache with streaming stores
+const size_t SPAN_STREAM_THRESHOLD = 1 << 18;
+
+// dst[0, count) = color
+extern void   Span_fill             (u32 *dst, size_t count, u32 color);
+
+// dst[i] = src[columns[i]], the nearest-neighbour row of a scaled blit
+extern void   Span_gather           (u32 *dst, const u32 *src, const i32 *columns, size_t count);
+
+// memcpy with non-temporal stores, for rows of a frame too large to stay
+// cached. Span_streamFence() orders them before anything else is written.
+extern void   Span_copyStream       (u32 *dst, const u32 *src, size_t count);
+extern void   Span_streamFence      ();
+
+// Swaps bytes 0 and 2 of every pixel, RGBA bytes <-> 0xAARRGGBB. dst may equal src.
+extern void   Span_swizzleRB        (u32 *dst, const u32 *src, size_t count);
+
+// Sprite compositing. Alpha test writes src pixels with alpha >= 128, blend
+// is dst = src + dst * (255 - src alpha) / 255 on premultiplied src, rounded.
+extern void   Span_alphaTest        (u32 *dst, const u32 *src, size_t count);
+extern void   Span_blend            (u32 *dst, const u32 *src, size_t count);
+
+// Straight to premultiplied alpha, for images drawn with Span_blend. dst may equal src.
+extern void   Span_premultiply      (u32 *dst, const u32 *src, size_t count);
+
+// Writes every step-th pixel of [0, count), starting at dst[0]
+extern void   Span_fillStrided      (u32 *dst, size_t count, i32 step, u32 color);
+
+// Per-ISA kernels, the scalar ones are the reference
+extern void   Span_fillScalar       (u32 *dst, size_t count, u32 color);
+extern void   Span_fillSSE2         (u32 *dst, size_t count, u32 color);
+extern void   Span_fillAVX2         (u32 *dst, size_t count, u32 color);
+extern void   Span_fillAVX512       (u32 *dst, size_t count, u32 color);
+extern void   Span_gatherScalar     (u32 *dst, const u32 *src, const i32 *columns, size_t count);
+extern void   Span_gatherAVX2       (u32 *dst, const u32 *src, const i32 *columns, size_t count);
+extern void   Span_gatherAVX512     (u32 *dst, const u32 *src, const i32 *columns, size_t count);
+extern void   Span_copyStreamSSE2   (u32 *dst, const u32 *src, size_t count);
+extern void   Span_copyStreamAVX2   (u32 *dst, const u32 *src, size_t count);
+extern void   Span_copyStreamAVX512 (u32 *dst, const u32 *src, size_t count);
+extern void   Span_swizzleRBScalar  (u32 *dst, const u32 *src, size_t count);
+extern void   Span_swizzleRBSSE2    (u32 *dst, const u32 *src, size_t count);
+extern void   Span_swizzleRBAVX2    (u32 *dst, const u32 *src, size_t count);
+extern void   Span_swizzleRBAVX512  (u32 *dst, const u32 *src, size_t count);
+extern void   Span_alphaTestScalar  (u32 *dst, const u32 *src, size_t count);
+extern void   Span_alphaTestSSE2    (u32 *dst, const u32 *src, size_t count);
+extern void   Span_alphaTestAVX2    (u32 *dst, const u32 *src, size_t count);
+extern void   Span_alphaTestAVX512  (u32 *dst, const u32 *src, size_t count);
+extern void   Span_blendScalar      (u32 *dst, const u32 *src, size_t count);
+extern void   Span_blendSSE2        (u32 *dst, const u32 *src, size_t count);
+extern void   Span_blendAVX2        (u32 *dst, const u32 *src, size_t count);
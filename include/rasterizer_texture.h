@@ -0,0 +1,146 @@
+#pragma once
+
+// Textures and their on-disk cache. The first load of an image decodes it,
+// swizzles it to 0xAARRGGBB, builds its mip chain and writes the result to
+// a cache blob keyed by the source path, size and modification time at the
+// file system's full resolution. Later
+// loads map the blob and use its pixels in place, so startup skips decoding
+// entirely.
+//
+// Textures are stored either row-major or in 4x4 texel blocks. A block is one
+// 64-byte cache line, so a bilinear footprint or a walk in any direction
+// usually stays within one line where row-major storage touches a new line
+// per texel row.
+//
+// Sampling walks a row of pixels in 16.16 fixed point and filters with
+// 8-bit weights, so every SIMD level returns exactly the scalar result and
+// a row split across tiles samples the same texels.
+
+#include <stddef.h>
+#include "rasterizer_graphics.h"
+#include "rasterizer_cache.h"
+
+const u32 TEXTURE_CACHE_MAGIC   = 0x58455452; // "RTEX"
+const u32 TEXTURE_CACHE_VERSION = 4;
+
+// Pixel data in a blob, and every mip level, starts on this boundary
+const u32 TEXTURE_CACHE_ALIGNMENT = 64;
+
+const u32 TEXTURE_MAX_LEVELS = 16;
+
+// Edge of a LAYOUT_BLOCKED block in texels, blocks are 16 texels
+const i32 TEXTURE_BLOCK_SIZE = 4;
+
+enum TEXTURE_STORAGE
+{
+    TEXTURE_NONE,
+    TEXTURE_OWNED,  // One aligned block holding the whole chain
+    TEXTURE_MAPPED  // Copy-on-write view of a cache blob
+};
+
+enum TEXTURE_LAYOUT
+{
+    LAYOUT_LINEAR,  // Row-major
+    LAYOUT_BLOCKED  // Row-major 4x4 blocks, texels row-major inside a block
+};
+
+enum TEXTURE_FILTER
+{
+    FILTER_NEAREST,     // Nearest texel of the nearest level
+    FILTER_BILINEAR,    // 2x2 texels of the nearest level
+    FILTER_TRILINEAR    // Bilinear in the two closest levels, blended
+};
+
+struct TextureLevel
+{
+    u32 *pixels;
+    i32 width;
+    i32 height;
+
+    // Blocked levels are padded to whole blocks
+    i32 blocksPerRow;
+};
+
+struct Texture
+{
+    // Level 0, in the texture's layout
+    u32 *pixels;
+    i32 width;
+    i32 height;
+    TEXTURE_LAYOUT layout;
+
+    // Each level halves the one above with a 2x2 box filter, down to 1x1
+    TextureLevel levels[TEXTURE_MAX_LEVELS];
+    u32 levelCount;
+
+    TEXTURE_STORAGE storage;
+    void *mapping;
+    size_t mappingSize;
+};
+
+// Fixed part of a cache blob, followed by the source path and the pixels
+struct TextureCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 sourceSize;
+    i64 sourceTime;
+    i32 width;
+    i32 height;
+    u32 layout;
+    u32 levelCount;
+    u32 pathLength;
+    u32 pixelOffset;
+};
+
+// One level's walk along a row, positions in 16.16 texels. Bilinear walks
+// are offset by half a texel so the integer part is the top-left texel.
+struct TextureWalk
+{
+    const u32 *pixels;
+    i32 width;
+    i32 height;
+    TEXTURE_LAYOUT layout;
+    i32 blocksPerRow;
+    i32 x;
+    i32 y;
+    i32 dx;
+    i32 dy;
+};
+
+// Where blobs are written, created on first use
+extern const char  *textureCacheDirectory;
+
+// Returns 0 when the image can't be decoded, like Graphics_loadImage.
+// Each layout has its own cache blob.
+extern int          Texture_load              (const char *path, Texture &texture, TEXTURE_LAYOUT layout);
+// Builds the chain from row-major level 0 pixels, then converts it to layout
+extern bool         Texture_create            (Texture &texture, const u32 *pixels, i32 width, i32 height, TEXTURE_LAYOUT layout);
+extern void         Texture_free              (Texture &texture);
+
+// Writes the blob for path, keyed by source as stat'ed before decoding so
+// an edit made meanwhile isn't stored under the new key. True on success.
+extern bool         Texture_storeCache        (const char *path, CacheSource source, const Texture &texture);
+
+// Level of detail for a footprint of du x dv in normalized coordinates per pixel
+extern float        Texture_lod               (const Texture &texture, float du, float dv);
+
+// Samples pixels first .. first + count - 1 of the row through (u, v) + i * (du, dv),
+// coordinates normalized with texel centres at (i + 0.5) / size, clamped to the edge.
+// Positions must stay within 2^15 texels of the level.
+extern void         Texture_sampleRow         (const Texture &texture, TEXTURE_FILTER filter, float lod,
+                                               float u, float v, float du, float dv, i32 first, u32 count, u32 *dst);
+extern u32          Texture_sample            (const Texture &texture, TEXTURE_FILTER filter, float lod, float u, float v);
+
+// Immediate filtered blit of the whole texture, defined with the other Graphics_ draws
+extern void         Graphics_blitTexture      (FrameBuffer &buffer, const Texture &texture, int x, int y, int w, int h, TEXTURE_FILTER filter);
+
+// Row kernels, count pixels from the walk's start
+extern void         Texture_nearestScalar     (const TextureWalk &walk, u32 count, u32 *dst);
+extern void         Texture_nearestAVX2       (const TextureWalk &walk, u32 count, u32 *dst);
+extern void         Texture_bilinearScalar    (const TextureWalk &walk, u32 count, u32 *dst);
+extern void         Texture_bilinearSSE2      (const TextureWalk &walk, u32 count, u32 *dst);
+extern void         Texture_bilinearAVX2      (const TextureWalk &walk, u32 count, u32 *dst);
+// dst = a + (b - a) * weight / 256 per channel
+extern void         Texture_lerpScalar        (const u32 *a, const u32 *b, u32 weight, u32 count, u32 *dst);
+extern void         Texture_lerpSSE2          (const u32 *a, const u32 *b, u32 weight, u32 count, u32 *dst);
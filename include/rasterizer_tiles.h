@@ -0,0 +1,103 @@
+#pragma once
+
+// Sort-middle rendering. A frame's draw calls are recorded into a
+// RenderQueue, binned to fixed screen tiles and rasterized tile by tile
+// on the worker pool. Each tile replays its commands in submission
+// order with the tile as clip rect, so the result matches drawing the
+// same queue in one pass.
+
+#include <vector>
+
+#include "rasterizer_graphics.h"
+#include "rasterizer_math.h"
+#include "rasterizer_raster.h"
+#include "rasterizer_layer.h"
+
+const i32 TILE_SIZE = 64;
+
+// A tile must own whole depth tiles so workers never share depth bounds
+static_assert(TILE_SIZE % DEPTH_TILE_SIZE == 0, "Render tiles must align with depth tiles");
+
+enum RENDER_COMMAND_TYPE
+{
+    COMMAND_CLEAR,
+    COMMAND_CLEAR_DEPTH,
+    COMMAND_GRID,
+    COMMAND_BACKGROUND,
+    COMMAND_RECTANGLE,
+    COMMAND_LINE,
+    COMMAND_LINES,
+    COMMAND_TRIANGLE,
+    COMMAND_BLIT,
+    COMMAND_BLIT_TEXTURE
+};
+
+struct RenderCommand
+{
+    RENDER_COMMAND_TYPE type;
+    u32 color;
+    float depth;
+
+    // Screen pixels the command may touch, used for binning
+    RasterRect bounds;
+
+    union
+    {
+        struct { i32 step; GRID_MODE mode; } grid;
+        struct { const GridLayer *layer; } background;
+        struct { RasterRect rect; RECT_MODE mode; } rectangle;
+        struct { i32 x0, y0, x1, y1; } line;
+        struct { const LineSegment *segments; u32 count; } lines;
+        struct { u32 *pixels; int imgW, imgH, x, y, w, h; BLIT_MODE mode; } blit;
+        struct { const Texture *texture; int x, y, w, h; TEXTURE_FILTER filter; } blitTexture;
+        TriangleSetup triangle;
+    };
+};
+
+struct RenderQueue
+{
+    std::vector<RenderCommand> commands;
+    u32 width;
+    u32 height;
+
+    // Applied to triangles as they are recorded, none after Queue_begin
+    RasterCull cull;
+};
+
+struct TileBins
+{
+    u32 tilesX;
+    u32 tilesY;
+
+    // Command indices per tile, in submission order
+    std::vector<std::vector<u32>> bins;
+
+    // Copies of the line batch segments touching each tile, so a tile reads
+    // its lines sequentially. lineGroups holds how many belong to each
+    // batch in the tile's bin, in the same order.
+    std::vector<std::vector<LineSegment>> lineBins;
+    std::vector<std::vector<u32>> lineGroups;
+};
+
+extern void   Queue_begin                 (RenderQueue &queue, u32 width, u32 height);
+extern void   Queue_clear                 (RenderQueue &queue, u32 color);
+extern void   Queue_setCull               (RenderQueue &queue, CULL_MODE mode, WINDING frontFace);
+extern void   Queue_clearDepth            (RenderQueue &queue, float depth);
+// Folded into a preceding full-screen clear as one cached background layer
+extern void   Queue_drawBackgroundGrid    (RenderQueue &queue, i32 step, GRID_MODE mode);
+extern void   Queue_drawRectangle         (RenderQueue &queue, i32 x0, i32 y0, i32 w, i32 h, u32 color, RECT_MODE mode);
+extern void   Queue_drawLine              (RenderQueue &queue, i32 x0, i32 y0, i32 x1, i32 y1, u32 color);
+// The segments are read when the queue executes and must stay alive until then
+extern void   Queue_drawLines             (RenderQueue &queue, const LineSegment *segments, u32 count);
+extern void   Queue_drawTriangle          (RenderQueue &queue, Vector2 v0, Vector2 v1, Vector2 v2, u32 color);
+extern void   Queue_drawRectangleDepth    (RenderQueue &queue, i32 x0, i32 y0, i32 w, i32 h, float depth, u32 color);
+extern void   Queue_drawTriangleDepth     (RenderQueue &queue, Vector3 v0, Vector3 v1, Vector3 v2, u32 color);
+extern void   Queue_blitImage             (RenderQueue &queue, u32 *imgPixels, int imgW, int imgH, int x, int y, int w, int h, BLIT_MODE mode);
+// The texture must stay alive until the queue executes
+extern void   Queue_blitTexture           (RenderQueue &queue, const Texture &texture, int x, int y, int w, int h, TEXTURE_FILTER filter);
+
+// Single pass on the calling thread, the reference for the tiled path
+extern void   Queue_execute               (FrameBuffer &buffer, RenderQueue &queue);
+
+extern void   Tiles_bin                   (TileBins &bins, RenderQueue &queue);
+extern void   Tiles_execute               (FrameBuffer &buffer, RenderQueue &queue, TileBins &bins);
@@ -0,0 +1,37 @@
+#pragma once
+
+// Scoped hot-path tracing exported as Chrome trace-event JSON
+// (chrome://tracing, ui.perfetto.dev). Build with RASTERIZER_TRACE
+// defined to enable it, otherwise every macro expands to nothing.
+
+#include <stdint.h>
+
+#ifdef RASTERIZER_TRACE
+
+struct TraceScope
+{
+    const char *name;
+    uint64_t startNs;
+
+    TraceScope(const char *scopeName);
+    ~TraceScope();
+};
+
+extern void Trace_record          (const char *name, uint64_t startNs, uint64_t endNs);
+extern uint64_t Trace_nowNs();
+extern int  Trace_writeChromeJSON (const char *filename);
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_SCOPE(name)   TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_FUNCTION()    TRACE_SCOPE(__func__)
+#define TRACE_WRITE(file)   Trace_writeChromeJSON(file)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_FUNCTION()
+#define TRACE_WRITE(file)
+
+#endif
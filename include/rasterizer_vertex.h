@@ -0,0 +1,38 @@
+#pragma once
+
+// Structure-of-arrays vertex streams. Each component lives in its own
+// 64-byte aligned array so the clip stage's transform kernels load 4, 8 or
+// 16 consecutive points per instruction.
+
+#include <stddef.h>
+#include "rasterizer_graphics.h"
+#include "rasterizer_math.h"
+
+const u32 VERTEX_STREAM_ALIGNMENT = 64;
+
+struct VertexStream
+{
+    float *x;
+    float *y;
+    float *z;
+    u32 count;
+    u32 capacity;
+};
+
+// Screen position plus view-space depth, ready for the rasterizer
+struct ProjectedStream
+{
+    float *x;
+    float *y;
+    float *depth;
+    u32 count;
+    u32 capacity;
+};
+
+extern void  *Vertex_alignedAlloc           (size_t size);
+extern void   Vertex_alignedFree            (void *memory);
+
+extern VertexStream     Vertex_createStream         (u32 capacity);
+extern void             Vertex_destroyStream        (VertexStream &stream);
+extern ProjectedStream  Vertex_createProjected      (u32 capacity);
+extern void             Vertex_destroyProjected     (ProjectedStream &stream);
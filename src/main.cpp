@@ -1,5 +1,6 @@
 #include <SDL.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 // Fixed Size Types (Avoid Implementation Specifics)
 #include <stdint.h>
@@ -10,20 +11,101 @@
 
 #include "rasterizer_graphics.h"
 #include "rasterizer_math.h"
+#include "rasterizer_trace.h"
+#include "rasterizer_clip.h"
+#include "rasterizer_pacing.h"
+
+// Usage: 3DRasterizer --headless <width> <height> [frames] [output.ppm] [threads]
+int runHeadless(int argc, char* argv[])
+{
+    if(argc < 4)
+    {
+        printf("Usage: %s --headless <width> <height> [frames] [output.ppm] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    u32 w = (u32) atoi(argv[2]);
+    u32 h = (u32) atoi(argv[3]);
+    int frames = argc > 4 ? atoi(argv[4]) : 1;
+    const char *output = argc > 5 ? argv[5] : "frame.ppm";
+
+    if(argc > 6)
+        renderThreads = (u32) atoi(argv[6]);
+
+    if(w == 0 || h == 0 || frames <= 0)
+    {
+        printf("Error: Invalid headless resolution or frame count\n");
+        return 1;
+    }
+
+    Graphics_initializeHeadless(w, h);
+
+    for(int i = 0; i < frames; i++)
+    {
+        TRACE_SCOPE("frame");
+
+        Graphics_simulate(1.0 / SIMULATION_RATE);
+        Graphics_update();
+        Graphics_render();
+    }
+
+    TRACE_WRITE("trace.json");
+
+    // Counts for the last frame
+    printf("Clip: %u points visible, %u culled, %u bounds culled, lines %u clipped %u culled, triangles %u clipped %u culled\n",
+           clipStats.pointsVisible, clipStats.pointsCulled, clipStats.boundsCulled,
+           clipStats.linesClipped, clipStats.linesCulled, clipStats.trianglesClipped, clipStats.trianglesCulled);
+    printf("Indexed: %u vertices transformed for %u indices, %u triangles with invalid indices\n",
+           clipStats.verticesTransformed, clipStats.indicesProcessed, clipStats.trianglesInvalid);
+    printf("Setup: triangles %u backfacing, %u degenerate, %u empty\n",
+           clipStats.trianglesBackfacing, clipStats.trianglesDegenerate, clipStats.trianglesEmpty);
+
+    int result = Graphics_writeFrameBufferPPM(output, buffer) ? 0 : 1;
+
+    Graphics_shutdown();
+    return result;
+}
 
 int main(int argc, char* argv[]) 
 {
+    if(argc > 1 && strcmp(argv[1], "--headless") == 0)
+        return runHeadless(argc, argv);
+
     Graphics_initializeWindow();
 
     // Real Full Screen
     // SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN);
 
-    // Event loop
+    FramePacer pacer;
+    Pacing_initialize(pacer, targetFrameRate, SIMULATION_RATE);
+
+    // Event loop, pipelined on multicore machines
+    if(window && pipelineFrames)
+        Graphics_runPipelined(pacer);
+
     while (!quit) 
     {    
+        TRACE_SCOPE("frame");
+
+        u32 steps = Pacing_beginFrame(pacer);
         Graphics_processInput();
+
+        for(u32 i = 0; i < steps; i++)
+            Graphics_simulate(Pacing_stepSeconds(pacer));
+
         Graphics_update();
         Graphics_render();
+        Graphics_present();
+
+        Pacing_endFrame(pacer);
     }
+
+    TRACE_WRITE("trace.json");
+
+    FrameStats stats = Pacing_stats(pacer);
+    printf("Frames: %u at %u Hz, interval %.3f ms mean, %.3f ms jitter, %.3f ms max, %u missed\n",
+           stats.frames, targetFrameRate, stats.meanMs, stats.jitterMs, stats.maxMs, stats.missed);
+
+    Graphics_shutdown();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "rasterizer_cache.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Whole-second mtimes would miss a same-size rewrite within one second
+bool Cache_statSource(const char *path, CacheSource &source)
+{
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if(!GetFileAttributesExA(path, GetFileExInfoStandard, &info))
+        return false;
+
+    source.size = ((u64) info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    source.time = (i64)(((u64) info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat info;
+    if(stat(path, &info) != 0)
+        return false;
+
+    source.size = (u64) info.st_size;
+#if defined(__APPLE__)
+    source.time = (i64) info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    source.time = (i64) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+
+    return true;
+}
+
+void Cache_blobPath(const char *directory, const char *path, const char *suffix, char *result, size_t capacity)
+{
+    u64 hash = 14695981039346656037ull;
+    for(const char *c = path; *c; c++)
+    {
+        hash ^= (u8) *c;
+        hash *= 1099511628211ull;
+    }
+
+    snprintf(result, capacity, "%s/%016llx%s", directory, (unsigned long long) hash, suffix);
+}
+
+void *Cache_mapFile(const char *filename, bool copyOnWrite, size_t &size)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = NULL;
+    void *view = nullptr;
+
+    if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        mapping = CreateFileMappingA(file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+
+    if(mapping)
+    {
+        view = MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+
+    CloseHandle(file);
+    size = view ? (size_t) fileSize.QuadPart : 0;
+    return view;
+#else
+    int file = open(filename, O_RDONLY);
+    if(file < 0)
+        return nullptr;
+
+    struct stat info;
+    void *view = nullptr;
+
+    if(fstat(file, &info) == 0 && info.st_size > 0)
+    {
+        int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+        view = mmap(NULL, (size_t) info.st_size, protection, MAP_PRIVATE, file, 0);
+        if(view == MAP_FAILED)
+            view = nullptr;
+        else
+            madvise(view, (size_t) info.st_size, copyOnWrite ? MADV_WILLNEED : MADV_SEQUENTIAL);
+    }
+
+    close(file);
+    size = view ? (size_t) info.st_size : 0;
+    return view;
+#endif
+}
+
+void Cache_unmapFile(const void *view, size_t size)
+{
+#if defined(_WIN32)
+    (void) size;
+    UnmapViewOfFile(view);
+#else
+    munmap((void*) view, size);
+#endif
+}
+
+bool Cache_beginWrite(CacheWriter &writer, const char *directory, const char *filename)
+{
+#if defined(_WIN32)
+    _mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+
+    writer.position = 0;
+    snprintf(writer.filename, sizeof(writer.filename), "%s", filename);
+
+    // Per process, so two writers of the same blob never share a file
+#if defined(_WIN32)
+    snprintf(writer.temporary, sizeof(writer.temporary), "%s.%d.tmp", filename, _getpid());
+#else
+    snprintf(writer.temporary, sizeof(writer.temporary), "%s.%d.tmp", filename, (int) getpid());
+#endif
+
+    writer.file = fopen(writer.temporary, "wb");
+    return writer.file != nullptr;
+}
+
+bool Cache_write(CacheWriter &writer, u64 offset, const void *data, size_t size)
+{
+    static const u8 padding[CACHE_ALIGNMENT] = {};
+
+    while(writer.position < offset)
+    {
+        size_t paddingSize = offset - writer.position < CACHE_ALIGNMENT ? (size_t)(offset - writer.position) : CACHE_ALIGNMENT;
+        if(fwrite(padding, 1, paddingSize, writer.file) != paddingSize)
+            return false;
+
+        writer.position += paddingSize;
+    }
+
+    if(fwrite(data, 1, size, writer.file) != size)
+        return false;
+
+    writer.position = offset + size;
+    return true;
+}
+
+bool Cache_endWrite(CacheWriter &writer, bool written)
+{
+    written = fclose(writer.file) == 0 && written;
+    writer.file = nullptr;
+
+#if defined(_WIN32)
+    if(written)
+        written = MoveFileExA(writer.temporary, writer.filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    if(written)
+        written = rename(writer.temporary, writer.filename) == 0;
+#endif
+
+    if(!written)
+        remove(writer.temporary);
+
+    return written;
+}
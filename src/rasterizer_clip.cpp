@@ -0,0 +1,836 @@
+#include "rasterizer_clip.h"
+#include "rasterizer_raster.h"
+#include "rasterizer_simd.h"
+#include "rasterizer_jobs.h"
+#include "rasterizer_trace.h"
+
+#include <string.h>
+#include <vector>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Points per parallel cull or transform task, large enough to amortize the hand-off
+const u32 CLIP_CHUNK_SIZE = 16384;
+
+const u32 CLIP_PLANE_COUNT = 5;
+
+ClipStats clipStats;
+
+void Clip_resetStats()
+{
+    clipStats = {};
+}
+
+ClipVolume Clip_screenVolume(float width, float height, float margin, float zNear)
+{
+    ClipVolume volume;
+    volume.minX = -margin;
+    volume.minY = -margin;
+    volume.maxX = width + margin;
+    volume.maxY = height + margin;
+    volume.zNear = zNear;
+    return volume;
+}
+
+// Signed distance to a plane, >= 0 inside. Linear in the clip
+// coordinates, so it can be interpolated along an edge.
+static float Clip_distance(const ClipVolume &volume, u32 plane, Vector4 v)
+{
+    switch(plane)
+    {
+        case CLIP_PLANE_NEAR:   return v.w - volume.zNear;
+        case CLIP_PLANE_LEFT:   return v.x - volume.minX * v.w;
+        case CLIP_PLANE_RIGHT:  return volume.maxX * v.w - v.x;
+        case CLIP_PLANE_TOP:    return v.y - volume.minY * v.w;
+        case CLIP_PLANE_BOTTOM: return volume.maxY * v.w - v.y;
+    }
+    return 0.0f;
+}
+
+u32 Clip_outcode(const ClipVolume &volume, Vector4 clip)
+{
+    u32 code = 0;
+    for(u32 i = 0; i < CLIP_PLANE_COUNT; i++)
+    {
+        if(Clip_distance(volume, 1 << i, clip) < 0.0f)
+            code |= 1 << i;
+    }
+    return code;
+}
+
+static Vector4 Clip_lerp(Vector4 a, Vector4 b, float t)
+{
+    return {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t};
+}
+
+bool Clip_cullBounds(const ClipVolume &volume, const Matrix4 &matrix, Vector3 min, Vector3 max)
+{
+    u32 outside = ~0u;
+    for(u32 i = 0; i < 8; i++)
+    {
+        Vector4 corner = {i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z, 1.0f};
+        outside &= Clip_outcode(volume, Math_transform(matrix, corner));
+    }
+
+    if(outside)
+        clipStats.boundsCulled++;
+    return outside != 0;
+}
+
+// Liang-Barsky in homogeneous space, one parametric interval for all planes
+bool Clip_line(const ClipVolume &volume, Vector4 &a, Vector4 &b)
+{
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+
+    for(u32 i = 0; i < CLIP_PLANE_COUNT; i++)
+    {
+        float da = Clip_distance(volume, 1 << i, a);
+        float db = Clip_distance(volume, 1 << i, b);
+
+        if(da < 0.0f && db < 0.0f)
+        {
+            clipStats.linesCulled++;
+            return false;
+        }
+
+        if(da < 0.0f)
+        {
+            float t = da / (da - db);
+            if(t > t0) t0 = t;
+        }
+        else if(db < 0.0f)
+        {
+            float t = da / (da - db);
+            if(t < t1) t1 = t;
+        }
+    }
+
+    if(t0 > t1)
+    {
+        clipStats.linesCulled++;
+        return false;
+    }
+
+    if(t0 > 0.0f || t1 < 1.0f)
+    {
+        Vector4 start = Clip_lerp(a, b, t0);
+        Vector4 end = Clip_lerp(a, b, t1);
+        a = start;
+        b = end;
+        clipStats.linesClipped++;
+    }
+    return true;
+}
+
+// Sutherland-Hodgman against a single plane
+static u32 Clip_polygon(const ClipVolume &volume, u32 plane, const Vector4 *in, u32 count, Vector4 *out)
+{
+    u32 outCount = 0;
+    for(u32 i = 0; i < count; i++)
+    {
+        Vector4 current = in[i];
+        Vector4 next = in[(i + 1) % count];
+        float dc = Clip_distance(volume, plane, current);
+        float dn = Clip_distance(volume, plane, next);
+
+        if(dc >= 0.0f)
+            out[outCount++] = current;
+
+        if((dc >= 0.0f) != (dn >= 0.0f))
+            out[outCount++] = Clip_lerp(current, next, dc / (dc - dn));
+    }
+    return outCount;
+}
+
+u32 Clip_triangle(const ClipVolume &volume, const Vector4 in[3], Vector4 out[CLIP_MAX_VERTICES])
+{
+    u32 codes[3] = {Clip_outcode(volume, in[0]), Clip_outcode(volume, in[1]), Clip_outcode(volume, in[2])};
+
+    if(codes[0] & codes[1] & codes[2])
+    {
+        clipStats.trianglesCulled++;
+        return 0;
+    }
+
+    out[0] = in[0];
+    out[1] = in[1];
+    out[2] = in[2];
+    u32 count = 3;
+
+    u32 crossed = codes[0] | codes[1] | codes[2];
+    if(crossed == 0)
+        return count;
+
+    Vector4 scratch[CLIP_MAX_VERTICES];
+
+    if(crossed & CLIP_PLANE_NEAR)
+    {
+        count = Clip_polygon(volume, CLIP_PLANE_NEAR, out, count, scratch);
+        memcpy(out, scratch, count * sizeof(Vector4));
+    }
+
+    // Off-screen parts are left to the rasterizer's clip unless they
+    // would project past the guard band
+    bool guardBand = true;
+    for(u32 i = 0; i < count; i++)
+    {
+        float limit = RASTER_GUARD_BAND * out[i].w;
+        if(out[i].x < -limit || out[i].x > limit || out[i].y < -limit || out[i].y > limit)
+            guardBand = false;
+    }
+
+    if(!guardBand)
+    {
+        for(u32 plane = CLIP_PLANE_LEFT; plane <= CLIP_PLANE_BOTTOM && count; plane <<= 1)
+        {
+            if(!(crossed & plane)) continue;
+
+            count = Clip_polygon(volume, plane, out, count, scratch);
+            memcpy(out, scratch, count * sizeof(Vector4));
+        }
+    }
+
+    if(count < 3)
+    {
+        clipStats.trianglesCulled++;
+        return 0;
+    }
+
+    clipStats.trianglesClipped++;
+    return count;
+}
+
+// Cull kernels pack survivors of [begin, end) starting at out[written] and
+// return the next free slot
+static u32 Clip_cullPointsScalar(const ClipVolume &volume, VertexStream &in, const Matrix4 &matrix, ProjectedStream &out, u32 *indices, u32 begin, u32 end, u32 written)
+{
+    const float (*m)[4] = matrix.m;
+
+    for(u32 i = begin; i < end; i++)
+    {
+        float x = in.x[i];
+        float y = in.y[i];
+        float z = in.z[i];
+
+        float clipX = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+        float clipY = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+        float clipZ = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+        float clipW = m[0][3] * x + m[1][3] * y + m[2][3] * z + m[3][3];
+
+        bool inside = clipW >= volume.zNear &&
+                      clipX >= volume.minX * clipW && clipX <= volume.maxX * clipW &&
+                      clipY >= volume.minY * clipW && clipY <= volume.maxY * clipW;
+        if(!inside) continue;
+
+        out.x[written] = clipX / clipW;
+        out.y[written] = clipY / clipW;
+        out.depth[written] = clipZ;
+        indices[written] = i;
+        written++;
+    }
+
+    return written;
+}
+
+#ifdef SIMD_X86
+
+// Every cull and transform kernel gets its clip coordinates here: the matrix
+// broadcast once per call, then Math_transform()'s products summed in its
+// order, no fused multiply-add, so each level matches the scalar path
+struct ClipSSE2Matrix
+{
+    __m128 m[4][4];
+};
+
+SIMD_TARGET("sse2")
+static inline ClipSSE2Matrix Clip_broadcastSSE2(const Matrix4 &matrix)
+{
+    ClipSSE2Matrix result;
+    for(u32 row = 0; row < 4; row++)
+        for(u32 column = 0; column < 4; column++)
+            result.m[row][column] = _mm_set1_ps(matrix.m[row][column]);
+    return result;
+}
+
+SIMD_TARGET("sse2")
+static inline void Clip_transformLanesSSE2(const ClipSSE2Matrix &m, const VertexStream &in, u32 i, __m128 &clipX, __m128 &clipY, __m128 &clipZ, __m128 &clipW)
+{
+    __m128 x = _mm_loadu_ps(in.x + i);
+    __m128 y = _mm_loadu_ps(in.y + i);
+    __m128 z = _mm_loadu_ps(in.z + i);
+    __m128 clip[4];
+
+    for(u32 column = 0; column < 4; column++)
+        clip[column] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m.m[0][column], x), _mm_mul_ps(m.m[1][column], y)), _mm_mul_ps(m.m[2][column], z)), m.m[3][column]);
+
+    clipX = clip[0];
+    clipY = clip[1];
+    clipZ = clip[2];
+    clipW = clip[3];
+}
+
+struct ClipAVX2Matrix
+{
+    __m256 m[4][4];
+};
+
+SIMD_TARGET("avx2")
+static inline ClipAVX2Matrix Clip_broadcastAVX2(const Matrix4 &matrix)
+{
+    ClipAVX2Matrix result;
+    for(u32 row = 0; row < 4; row++)
+        for(u32 column = 0; column < 4; column++)
+            result.m[row][column] = _mm256_set1_ps(matrix.m[row][column]);
+    return result;
+}
+
+SIMD_TARGET("avx2")
+static inline void Clip_transformLanesAVX2(const ClipAVX2Matrix &m, const VertexStream &in, u32 i, __m256 &clipX, __m256 &clipY, __m256 &clipZ, __m256 &clipW)
+{
+    __m256 x = _mm256_loadu_ps(in.x + i);
+    __m256 y = _mm256_loadu_ps(in.y + i);
+    __m256 z = _mm256_loadu_ps(in.z + i);
+    __m256 clip[4];
+
+    for(u32 column = 0; column < 4; column++)
+        clip[column] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m.m[0][column], x), _mm256_mul_ps(m.m[1][column], y)), _mm256_mul_ps(m.m[2][column], z)), m.m[3][column]);
+
+    clipX = clip[0];
+    clipY = clip[1];
+    clipZ = clip[2];
+    clipW = clip[3];
+}
+
+struct ClipAVX512Matrix
+{
+    __m512 m[4][4];
+};
+
+SIMD_TARGET("avx512f")
+static inline ClipAVX512Matrix Clip_broadcastAVX512(const Matrix4 &matrix)
+{
+    ClipAVX512Matrix result;
+    for(u32 row = 0; row < 4; row++)
+        for(u32 column = 0; column < 4; column++)
+            result.m[row][column] = _mm512_set1_ps(matrix.m[row][column]);
+    return result;
+}
+
+SIMD_TARGET("avx512f")
+static inline void Clip_transformLanesAVX512(const ClipAVX512Matrix &m, const VertexStream &in, u32 i, __m512 &clipX, __m512 &clipY, __m512 &clipZ, __m512 &clipW)
+{
+    __m512 x = _mm512_loadu_ps(in.x + i);
+    __m512 y = _mm512_loadu_ps(in.y + i);
+    __m512 z = _mm512_loadu_ps(in.z + i);
+    __m512 clip[4];
+
+    // avx512f brings fused multiply-add along, and the compiler would contract
+    // plain multiplies and adds into it. The explicit-rounding forms round the
+    // same way but are never fused.
+    const int ROUND = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+
+    for(u32 column = 0; column < 4; column++)
+    {
+        __m512 sum = _mm512_add_round_ps(_mm512_mul_round_ps(m.m[0][column], x, ROUND), _mm512_mul_round_ps(m.m[1][column], y, ROUND), ROUND);
+        sum = _mm512_add_round_ps(sum, _mm512_mul_round_ps(m.m[2][column], z, ROUND), ROUND);
+        clip[column] = _mm512_add_round_ps(sum, m.m[3][column], ROUND);
+    }
+
+    clipX = clip[0];
+    clipY = clip[1];
+    clipZ = clip[2];
+    clipW = clip[3];
+}
+
+SIMD_TARGET("sse2")
+static u32 Clip_cullPointsSSE2(const ClipVolume &volume, VertexStream &in, const Matrix4 &matrix, ProjectedStream &out, u32 *indices, u32 begin, u32 end, u32 written)
+{
+    ClipSSE2Matrix m = Clip_broadcastSSE2(matrix);
+    __m128 minX = _mm_set1_ps(volume.minX), maxX = _mm_set1_ps(volume.maxX);
+    __m128 minY = _mm_set1_ps(volume.minY), maxY = _mm_set1_ps(volume.maxY);
+    __m128 zNear = _mm_set1_ps(volume.zNear);
+    __m128 two = _mm_set1_ps(2.0f);
+
+    alignas(16) float sx[4], sy[4], sz[4];
+
+    u32 i = begin;
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 clipX, clipY, clipZ, clipW;
+        Clip_transformLanesSSE2(m, in, i, clipX, clipY, clipZ, clipW);
+
+        __m128 inside = _mm_cmpge_ps(clipW, zNear);
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(clipX, _mm_mul_ps(minX, clipW)));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(clipX, _mm_mul_ps(maxX, clipW)));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(clipY, _mm_mul_ps(minY, clipW)));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(clipY, _mm_mul_ps(maxY, clipW)));
+
+        int mask = _mm_movemask_ps(inside);
+        if(!mask) continue;
+
+        __m128 r = _mm_rcp_ps(clipW);
+        r = _mm_mul_ps(r, _mm_sub_ps(two, _mm_mul_ps(clipW, r)));
+
+        _mm_store_ps(sx, _mm_mul_ps(clipX, r));
+        _mm_store_ps(sy, _mm_mul_ps(clipY, r));
+        _mm_store_ps(sz, clipZ);
+
+        for(u32 lane = 0; lane < 4; lane++)
+        {
+            if(!(mask & (1 << lane))) continue;
+
+            out.x[written] = sx[lane];
+            out.y[written] = sy[lane];
+            out.depth[written] = sz[lane];
+            indices[written] = i + lane;
+            written++;
+        }
+    }
+
+    return Clip_cullPointsScalar(volume, in, matrix, out, indices, i, end, written);
+}
+
+SIMD_TARGET("avx2")
+static u32 Clip_cullPointsAVX2(const ClipVolume &volume, VertexStream &in, const Matrix4 &matrix, ProjectedStream &out, u32 *indices, u32 begin, u32 end, u32 written)
+{
+    ClipAVX2Matrix m = Clip_broadcastAVX2(matrix);
+    __m256 minX = _mm256_set1_ps(volume.minX), maxX = _mm256_set1_ps(volume.maxX);
+    __m256 minY = _mm256_set1_ps(volume.minY), maxY = _mm256_set1_ps(volume.maxY);
+    __m256 zNear = _mm256_set1_ps(volume.zNear);
+    __m256 two = _mm256_set1_ps(2.0f);
+
+    alignas(32) float sx[8], sy[8], sz[8];
+
+    u32 i = begin;
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 clipX, clipY, clipZ, clipW;
+        Clip_transformLanesAVX2(m, in, i, clipX, clipY, clipZ, clipW);
+
+        __m256 inside = _mm256_cmp_ps(clipW, zNear, _CMP_GE_OQ);
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(clipX, _mm256_mul_ps(minX, clipW), _CMP_GE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(clipX, _mm256_mul_ps(maxX, clipW), _CMP_LE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(clipY, _mm256_mul_ps(minY, clipW), _CMP_GE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(clipY, _mm256_mul_ps(maxY, clipW), _CMP_LE_OQ));
+
+        int mask = _mm256_movemask_ps(inside);
+        if(!mask) continue;
+
+        __m256 r = _mm256_rcp_ps(clipW);
+        r = _mm256_mul_ps(r, _mm256_sub_ps(two, _mm256_mul_ps(clipW, r)));
+
+        _mm256_store_ps(sx, _mm256_mul_ps(clipX, r));
+        _mm256_store_ps(sy, _mm256_mul_ps(clipY, r));
+        _mm256_store_ps(sz, clipZ);
+
+        for(u32 lane = 0; lane < 8; lane++)
+        {
+            if(!(mask & (1 << lane))) continue;
+
+            out.x[written] = sx[lane];
+            out.y[written] = sy[lane];
+            out.depth[written] = sz[lane];
+            indices[written] = i + lane;
+            written++;
+        }
+    }
+
+    return Clip_cullPointsScalar(volume, in, matrix, out, indices, i, end, written);
+}
+
+// Survivors are packed with compress stores, no per-lane loop
+SIMD_TARGET("avx512f,popcnt")
+static u32 Clip_cullPointsAVX512(const ClipVolume &volume, VertexStream &in, const Matrix4 &matrix, ProjectedStream &out, u32 *indices, u32 begin, u32 end, u32 written)
+{
+    ClipAVX512Matrix m = Clip_broadcastAVX512(matrix);
+    __m512 minX = _mm512_set1_ps(volume.minX), maxX = _mm512_set1_ps(volume.maxX);
+    __m512 minY = _mm512_set1_ps(volume.minY), maxY = _mm512_set1_ps(volume.maxY);
+    __m512 zNear = _mm512_set1_ps(volume.zNear);
+    __m512 two = _mm512_set1_ps(2.0f);
+    __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    u32 i = begin;
+    for(; i + 16 <= end; i += 16)
+    {
+        __m512 clipX, clipY, clipZ, clipW;
+        Clip_transformLanesAVX512(m, in, i, clipX, clipY, clipZ, clipW);
+
+        __mmask16 inside = _mm512_cmp_ps_mask(clipW, zNear, _CMP_GE_OQ);
+        inside = _mm512_mask_cmp_ps_mask(inside, clipX, _mm512_mul_ps(minX, clipW), _CMP_GE_OQ);
+        inside = _mm512_mask_cmp_ps_mask(inside, clipX, _mm512_mul_ps(maxX, clipW), _CMP_LE_OQ);
+        inside = _mm512_mask_cmp_ps_mask(inside, clipY, _mm512_mul_ps(minY, clipW), _CMP_GE_OQ);
+        inside = _mm512_mask_cmp_ps_mask(inside, clipY, _mm512_mul_ps(maxY, clipW), _CMP_LE_OQ);
+        if(!inside) continue;
+
+        __m512 r = _mm512_rcp14_ps(clipW);
+        r = _mm512_mul_ps(r, _mm512_fnmadd_ps(clipW, r, two));
+
+        _mm512_mask_compressstoreu_ps(out.x + written, inside, _mm512_mul_ps(clipX, r));
+        _mm512_mask_compressstoreu_ps(out.y + written, inside, _mm512_mul_ps(clipY, r));
+        _mm512_mask_compressstoreu_ps(out.depth + written, inside, clipZ);
+        _mm512_mask_compressstoreu_epi32(indices + written, inside, _mm512_add_epi32(lanes, _mm512_set1_epi32((int) i)));
+        written += _mm_popcnt_u32(inside);
+    }
+
+    return Clip_cullPointsScalar(volume, in, matrix, out, indices, i, end, written);
+}
+
+#endif
+
+typedef u32 (*CullFunction)(const ClipVolume &volume, VertexStream &in, const Matrix4 &matrix, ProjectedStream &out, u32 *indices, u32 begin, u32 end, u32 written);
+
+struct CullJob
+{
+    const ClipVolume *volume;
+    VertexStream *in;
+    const Matrix4 *matrix;
+    ProjectedStream *out;
+    u32 *indices;
+    u32 *chunkCounts;
+    CullFunction function;
+};
+
+// Each chunk packs into its own slice of out, compacted afterwards
+static void Clip_cullChunk(void *context, u32 index, u32 worker)
+{
+    (void) worker;
+
+    CullJob &job = *(CullJob*) context;
+
+    u32 begin = index * CLIP_CHUNK_SIZE;
+    u32 end = begin + CLIP_CHUNK_SIZE < job.in->count ? begin + CLIP_CHUNK_SIZE : job.in->count;
+
+    job.chunkCounts[index] = job.function(*job.volume, *job.in, *job.matrix, *job.out, job.indices, begin, end, begin) - begin;
+}
+
+u32 Clip_cullPoints(const ClipVolume &volume, VertexStream &in, const Matrix4 &matrix, ProjectedStream &out, u32 *indices)
+{
+    TRACE_FUNCTION();
+
+    CullFunction function = Clip_cullPointsScalar;
+#ifdef SIMD_X86
+    switch(simdLevel)
+    {
+        case SIMD_AVX512: function = Clip_cullPointsAVX512; break;
+        case SIMD_AVX2:   function = Clip_cullPointsAVX2;   break;
+        case SIMD_SSE2:   function = Clip_cullPointsSSE2;   break;
+        default: break;
+    }
+#endif
+
+    u32 visible;
+    if(in.count <= CLIP_CHUNK_SIZE)
+    {
+        visible = function(volume, in, matrix, out, indices, 0, in.count, 0);
+    }
+    else
+    {
+        u32 chunks = (in.count + CLIP_CHUNK_SIZE - 1) / CLIP_CHUNK_SIZE;
+        std::vector<u32> chunkCounts(chunks);
+
+        CullJob job = {&volume, &in, &matrix, &out, indices, chunkCounts.data(), function};
+        Jobs_parallelFor(chunks, Clip_cullChunk, &job);
+
+        visible = chunkCounts[0];
+        for(u32 chunk = 1; chunk < chunks; chunk++)
+        {
+            u32 source = chunk * CLIP_CHUNK_SIZE;
+            u32 count = chunkCounts[chunk];
+
+            memmove(out.x + visible, out.x + source, count * sizeof(float));
+            memmove(out.y + visible, out.y + source, count * sizeof(float));
+            memmove(out.depth + visible, out.depth + source, count * sizeof(float));
+            memmove(indices + visible, indices + source, count * sizeof(u32));
+            visible += count;
+        }
+    }
+
+    out.count = visible;
+    clipStats.pointsVisible += visible;
+    clipStats.pointsCulled += in.count - visible;
+    return visible;
+}
+
+ClipVertexBuffer Clip_createVertexBuffer(u32 capacity)
+{
+    ClipVertexBuffer buffer = {};
+    buffer.x = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    buffer.y = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    buffer.z = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    buffer.w = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    buffer.screenX = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    buffer.screenY = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    buffer.outcodes = (u8*) Vertex_alignedAlloc(capacity);
+    buffer.capacity = capacity;
+    return buffer;
+}
+
+void Clip_destroyVertexBuffer(ClipVertexBuffer &buffer)
+{
+    Vertex_alignedFree(buffer.x);
+    Vertex_alignedFree(buffer.y);
+    Vertex_alignedFree(buffer.z);
+    Vertex_alignedFree(buffer.w);
+    Vertex_alignedFree(buffer.screenX);
+    Vertex_alignedFree(buffer.screenY);
+    Vertex_alignedFree(buffer.outcodes);
+    buffer = {};
+}
+
+// Same products and sums in the same order as Math_transform(), no fused
+// multiply-add, so every level produces the clip coordinates
+// Clip_drawTriangle() would
+void Clip_transformScalar(const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end)
+{
+    const float (*m)[4] = matrix.m;
+
+    for(u32 i = begin; i < end; i++)
+    {
+        float x = in.x[i];
+        float y = in.y[i];
+        float z = in.z[i];
+
+        Vector4 clip;
+        clip.x = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+        clip.y = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+        clip.z = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+        clip.w = m[0][3] * x + m[1][3] * y + m[2][3] * z + m[3][3];
+
+        out.x[i] = clip.x;
+        out.y[i] = clip.y;
+        out.z[i] = clip.z;
+        out.w[i] = clip.w;
+        out.screenX[i] = clip.x / clip.w;
+        out.screenY[i] = clip.y / clip.w;
+        out.outcodes[i] = (u8) Clip_outcode(volume, clip);
+    }
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+void Clip_transformSSE2(const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end)
+{
+    ClipSSE2Matrix m = Clip_broadcastSSE2(matrix);
+    __m128 minX = _mm_set1_ps(volume.minX), maxX = _mm_set1_ps(volume.maxX);
+    __m128 minY = _mm_set1_ps(volume.minY), maxY = _mm_set1_ps(volume.maxY);
+    __m128 zNear = _mm_set1_ps(volume.zNear);
+    __m128 zero = _mm_setzero_ps();
+
+    u32 i = begin;
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 clipX, clipY, clipZ, clipW;
+        Clip_transformLanesSSE2(m, in, i, clipX, clipY, clipZ, clipW);
+
+        _mm_storeu_ps(out.x + i, clipX);
+        _mm_storeu_ps(out.y + i, clipY);
+        _mm_storeu_ps(out.z + i, clipZ);
+        _mm_storeu_ps(out.w + i, clipW);
+        _mm_storeu_ps(out.screenX + i, _mm_div_ps(clipX, clipW));
+        _mm_storeu_ps(out.screenY + i, _mm_div_ps(clipY, clipW));
+
+        // Plane distances as in Clip_distance(), one bit per negative one
+        __m128i code = _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(_mm_sub_ps(clipW, zNear), zero)), _mm_set1_epi32(CLIP_PLANE_NEAR));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(_mm_sub_ps(clipX, _mm_mul_ps(minX, clipW)), zero)), _mm_set1_epi32(CLIP_PLANE_LEFT)));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(_mm_sub_ps(_mm_mul_ps(maxX, clipW), clipX), zero)), _mm_set1_epi32(CLIP_PLANE_RIGHT)));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(_mm_sub_ps(clipY, _mm_mul_ps(minY, clipW)), zero)), _mm_set1_epi32(CLIP_PLANE_TOP)));
+        code = _mm_or_si128(code, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(_mm_sub_ps(_mm_mul_ps(maxY, clipW), clipY), zero)), _mm_set1_epi32(CLIP_PLANE_BOTTOM)));
+
+        code = _mm_packs_epi32(code, code);
+        code = _mm_packus_epi16(code, code);
+        u32 codes = (u32) _mm_cvtsi128_si32(code);
+        memcpy(out.outcodes + i, &codes, sizeof(codes));
+    }
+
+    Clip_transformScalar(volume, in, matrix, out, i, end);
+}
+
+SIMD_TARGET("avx2")
+void Clip_transformAVX2(const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end)
+{
+    ClipAVX2Matrix m = Clip_broadcastAVX2(matrix);
+    __m256 minX = _mm256_set1_ps(volume.minX), maxX = _mm256_set1_ps(volume.maxX);
+    __m256 minY = _mm256_set1_ps(volume.minY), maxY = _mm256_set1_ps(volume.maxY);
+    __m256 zNear = _mm256_set1_ps(volume.zNear);
+    __m256 zero = _mm256_setzero_ps();
+
+    u32 i = begin;
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 clipX, clipY, clipZ, clipW;
+        Clip_transformLanesAVX2(m, in, i, clipX, clipY, clipZ, clipW);
+
+        _mm256_storeu_ps(out.x + i, clipX);
+        _mm256_storeu_ps(out.y + i, clipY);
+        _mm256_storeu_ps(out.z + i, clipZ);
+        _mm256_storeu_ps(out.w + i, clipW);
+        _mm256_storeu_ps(out.screenX + i, _mm256_div_ps(clipX, clipW));
+        _mm256_storeu_ps(out.screenY + i, _mm256_div_ps(clipY, clipW));
+
+        __m256i code = _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(_mm256_sub_ps(clipW, zNear), zero, _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_PLANE_NEAR));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(_mm256_sub_ps(clipX, _mm256_mul_ps(minX, clipW)), zero, _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_PLANE_LEFT)));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(_mm256_sub_ps(_mm256_mul_ps(maxX, clipW), clipX), zero, _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_PLANE_RIGHT)));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(_mm256_sub_ps(clipY, _mm256_mul_ps(minY, clipW)), zero, _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_PLANE_TOP)));
+        code = _mm256_or_si256(code, _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(_mm256_sub_ps(_mm256_mul_ps(maxY, clipW), clipY), zero, _CMP_LT_OQ)), _mm256_set1_epi32(CLIP_PLANE_BOTTOM)));
+
+        __m128i codes = _mm_packs_epi32(_mm256_castsi256_si128(code), _mm256_extracti128_si256(code, 1));
+        _mm_storel_epi64((__m128i*)(out.outcodes + i), _mm_packus_epi16(codes, codes));
+    }
+
+    Clip_transformScalar(volume, in, matrix, out, i, end);
+}
+
+#else
+
+void Clip_transformSSE2(const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end) { Clip_transformScalar(volume, in, matrix, out, begin, end); }
+void Clip_transformAVX2(const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end) { Clip_transformScalar(volume, in, matrix, out, begin, end); }
+
+#endif
+
+typedef void (*ClipTransformFunction)(const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out, u32 begin, u32 end);
+
+struct ClipTransformJob
+{
+    const ClipVolume *volume;
+    const VertexStream *in;
+    const Matrix4 *matrix;
+    ClipVertexBuffer *out;
+    ClipTransformFunction function;
+};
+
+static void Clip_transformChunk(void *context, u32 index, u32 worker)
+{
+    (void) worker;
+
+    ClipTransformJob &job = *(ClipTransformJob*) context;
+
+    u32 begin = index * CLIP_CHUNK_SIZE;
+    u32 end = begin + CLIP_CHUNK_SIZE < job.out->count ? begin + CLIP_CHUNK_SIZE : job.out->count;
+
+    job.function(*job.volume, *job.in, *job.matrix, *job.out, begin, end);
+}
+
+void Clip_transformVertices(const ClipVolume &volume, const VertexStream &in, const Matrix4 &matrix, ClipVertexBuffer &out)
+{
+    TRACE_FUNCTION();
+
+    ClipTransformFunction function = Clip_transformScalar;
+    switch(simdLevel)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2:   function = Clip_transformAVX2; break;
+        case SIMD_SSE2:   function = Clip_transformSSE2; break;
+        default: break;
+    }
+
+    // Never write past the buffer, the caller sized it for the stream
+    u32 count = in.count < out.capacity ? in.count : out.capacity;
+
+    out.count = count;
+    clipStats.verticesTransformed += count;
+
+    if(count <= CLIP_CHUNK_SIZE)
+    {
+        function(volume, in, matrix, out, 0, count);
+        return;
+    }
+
+    ClipTransformJob job = {&volume, &in, &matrix, &out, function};
+    Jobs_parallelFor((count + CLIP_CHUNK_SIZE - 1) / CLIP_CHUNK_SIZE, Clip_transformChunk, &job);
+}
+
+void Clip_drawIndexed(RenderQueue &queue, const ClipVolume &volume, const ClipVertexBuffer &vertices,
+                      const u32 *indices, u32 triangleCount, u32 color)
+{
+    TRACE_FUNCTION();
+
+    clipStats.indicesProcessed += triangleCount * 3;
+
+    for(u32 t = 0; t < triangleCount; t++)
+    {
+        u32 a = indices[t * 3];
+        u32 b = indices[t * 3 + 1];
+        u32 c = indices[t * 3 + 2];
+
+        if(a >= vertices.count || b >= vertices.count || c >= vertices.count)
+        {
+            clipStats.trianglesInvalid++;
+            continue;
+        }
+
+        u32 codeA = vertices.outcodes[a], codeB = vertices.outcodes[b], codeC = vertices.outcodes[c];
+
+        if(codeA & codeB & codeC)
+        {
+            clipStats.trianglesCulled++;
+            continue;
+        }
+
+        // Common case: every corner already divided in the buffer
+        if(!(codeA | codeB | codeC))
+        {
+            Queue_drawTriangleDepth(queue, {vertices.screenX[a], vertices.screenY[a], vertices.z[a]},
+                                           {vertices.screenX[b], vertices.screenY[b], vertices.z[b]},
+                                           {vertices.screenX[c], vertices.screenY[c], vertices.z[c]}, color);
+            continue;
+        }
+
+        Vector4 clip[3] =
+        {
+            {vertices.x[a], vertices.y[a], vertices.z[a], vertices.w[a]},
+            {vertices.x[b], vertices.y[b], vertices.z[b], vertices.w[b]},
+            {vertices.x[c], vertices.y[c], vertices.z[c], vertices.w[c]},
+        };
+
+        Vector4 polygon[CLIP_MAX_VERTICES];
+        u32 count = Clip_triangle(volume, clip, polygon);
+        if(count == 0)
+            continue;
+
+        Vector3 screen[CLIP_MAX_VERTICES];
+        for(u32 i = 0; i < count; i++)
+            screen[i] = {polygon[i].x / polygon[i].w, polygon[i].y / polygon[i].w, polygon[i].z};
+
+        for(u32 i = 1; i + 1 < count; i++)
+            Queue_drawTriangleDepth(queue, screen[0], screen[i], screen[i + 1], color);
+    }
+}
+
+void Clip_drawLine(RenderQueue &queue, const ClipVolume &volume, const Matrix4 &matrix, Vector3 a, Vector3 b, u32 color)
+{
+    Vector4 start = Math_transform(matrix, {a.x, a.y, a.z, 1.0f});
+    Vector4 end = Math_transform(matrix, {b.x, b.y, b.z, 1.0f});
+
+    if(!Clip_line(volume, start, end))
+        return;
+
+    Queue_drawLine(queue, (i32) (start.x / start.w), (i32) (start.y / start.w),
+                          (i32) (end.x / end.w), (i32) (end.y / end.w), color);
+}
+
+void Clip_drawTriangle(RenderQueue &queue, const ClipVolume &volume, const Matrix4 &matrix, Vector3 v0, Vector3 v1, Vector3 v2, u32 color)
+{
+    Vector4 clip[3] =
+    {
+        Math_transform(matrix, {v0.x, v0.y, v0.z, 1.0f}),
+        Math_transform(matrix, {v1.x, v1.y, v1.z, 1.0f}),
+        Math_transform(matrix, {v2.x, v2.y, v2.z, 1.0f}),
+    };
+
+    Vector4 polygon[CLIP_MAX_VERTICES];
+    u32 count = Clip_triangle(volume, clip, polygon);
+    if(count == 0)
+        return;
+
+    // Every vertex is in front of the near plane now, safe to divide
+    Vector3 screen[CLIP_MAX_VERTICES];
+    for(u32 i = 0; i < count; i++)
+        screen[i] = {polygon[i].x / polygon[i].w, polygon[i].y / polygon[i].w, polygon[i].z};
+
+    for(u32 i = 1; i + 1 < count; i++)
+        Queue_drawTriangleDepth(queue, screen[0], screen[i], screen[i + 1], color);
+}
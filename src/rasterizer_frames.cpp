@@ -0,0 +1,104 @@
+#include "rasterizer_frames.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// The pending word holds a slot index, with this bit set while the slot
+// holds a frame the presenter hasn't taken
+const u32 FRAME_FRESH = 1 << 2;
+
+struct FrameExchange
+{
+    FrameBuffer slots[FRAME_SLOTS];
+
+    // Owned by the render and present sides respectively
+    u32 back;
+    u32 front;
+
+    alignas(64) std::atomic<u32> pending;
+
+    // Wakes the renderer once its frame is taken
+    std::mutex mutex;
+    std::condition_variable consumed;
+    bool stopped;
+};
+
+globalVariable FrameExchange exchange;
+
+void Frames_initialize(u32 width, u32 height)
+{
+    Frames_shutdown();
+
+    for(u32 i = 0; i < FRAME_SLOTS; i++)
+        exchange.slots[i] = Graphics_createColorBuffer(width, height);
+
+    Graphics_createDepthBuffer(exchange.slots[0]);
+
+    for(u32 i = 1; i < FRAME_SLOTS; i++)
+        exchange.slots[i].depth = exchange.slots[0].depth;
+
+    exchange.back = 0;
+    exchange.front = 1;
+    exchange.pending.store(2, std::memory_order_relaxed);
+    exchange.stopped = false;
+}
+
+void Frames_shutdown()
+{
+    for(u32 i = 1; i < FRAME_SLOTS; i++)
+        exchange.slots[i].depth = nullptr;
+
+    for(u32 i = 0; i < FRAME_SLOTS; i++)
+        Graphics_destroyColorBuffer(exchange.slots[i]);
+}
+
+FrameBuffer& Frames_back()
+{
+    return exchange.slots[exchange.back];
+}
+
+FrameBuffer& Frames_publish()
+{
+    // Release makes the finished pixels visible with the index
+    u32 previous = exchange.pending.exchange(exchange.back | FRAME_FRESH, std::memory_order_acq_rel);
+    exchange.back = previous & ~FRAME_FRESH;
+    return exchange.slots[exchange.back];
+}
+
+FrameBuffer* Frames_acquire()
+{
+    if(!(exchange.pending.load(std::memory_order_relaxed) & FRAME_FRESH))
+        return nullptr;
+
+    // Acquire pairs with the publish, the old front goes back to the renderer
+    u32 previous = exchange.pending.exchange(exchange.front, std::memory_order_acq_rel);
+    exchange.front = previous & ~FRAME_FRESH;
+
+    // Taken under the lock so the renderer can't miss the wakeup between
+    // checking the word and sleeping
+    {
+        std::lock_guard<std::mutex> lock(exchange.mutex);
+    }
+    exchange.consumed.notify_one();
+
+    return &exchange.slots[exchange.front];
+}
+
+void Frames_waitConsumed()
+{
+    std::unique_lock<std::mutex> lock(exchange.mutex);
+    exchange.consumed.wait(lock, []()
+    {
+        return exchange.stopped || !(exchange.pending.load(std::memory_order_acquire) & FRAME_FRESH);
+    });
+}
+
+void Frames_stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(exchange.mutex);
+        exchange.stopped = true;
+    }
+    exchange.consumed.notify_one();
+}
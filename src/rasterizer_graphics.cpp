@@ -4,6 +4,23 @@
 #include "stb_image.h"
 
 #include "rasterizer_math.h"
+#include "rasterizer_trace.h"
+#include "rasterizer_simd.h"
+#include "rasterizer_raster.h"
+#include "rasterizer_tiles.h"
+#include "rasterizer_jobs.h"
+#include "rasterizer_vertex.h"
+#include "rasterizer_clip.h"
+#include "rasterizer_layer.h"
+#include "rasterizer_texture.h"
+#include "rasterizer_span.h"
+#include "rasterizer_frames.h"
+#include "rasterizer_pacing.h"
+#include "rasterizer_mesh.h"
+#include "rasterizer_scene.h"
+
+#include <atomic>
+#include <thread>
 
 // Define global variables here
 int windowWidth      = 800;
@@ -12,29 +29,50 @@ SDL_Window* window   = nullptr;
 bool quit            = false;
 FrameBuffer buffer;
 SDL_Surface *windowSurface = nullptr;
-
-// Cube Points
+u32 renderThreads    = 0; // 0 uses every hardware thread
+PRESENT_MODE presentMode = PRESENT_COPY;
+bool pipelineFrames  = true;
+u32 targetFrameRate  = 0;
+double simulationTime = 0; // Seconds of simulation stepped so far
+
+// Per-frame draw commands and their tile bins, reused across frames
+RenderQueue frameQueue;
+TileBins frameBins;
+
+// Cube Points, or the vertices of sceneMeshPath when it exists. The transform
+// reads the mesh's position stream in place, mapped straight from its cache.
 const int M_POINTS = 9 * 9 * 9;
-Vector3 cloudOfPoints[M_POINTS];
-Vector2 projectedPoints[M_POINTS];
+const char *sceneMeshPath = "./res/points.obj";
+Mesh cloudOfPoints;
+ProjectedStream projectedPoints;
+u32 *visiblePoints; // Source point of each projected point that survived culling
+ClipVertexBuffer meshVertices; // Transformed once per frame for the mesh's indexed triangles
+ClipVolume meshVolume;
+
+// Scene transforms, the cloud is drawn with its node's world matrix
+SceneGraph sceneGraph;
+u32 cloudNode = SCENE_NONE;
+const i32 POINT_SIZE = 5;
 float fovFactor = 128 * 6;
 Vector3 cameraPosition = {0, 0, -5};
 
 // Bitmap Testing
-u32 *pixels;
-int w, h;
+Texture image;
     
 
 int Graphics_loadImage(const char *filename, u32 **pixels, int *width, int *height) 
 {
+    TRACE_FUNCTION();
+
     // Load the image using stb_image
     int channels;
     unsigned char *data = stbi_load(filename, width, height, &channels, 4); // 4 channels for RGBA
 
     if (data == NULL) 
     {
-        printf("Error: Failed to load image: %s\n", filename);
-        printf("stbi_error: %s\n", stbi_failure_reason());  // This prints a more detailed error message
+        // Diagnostics go to stderr, stdout may be carrying bench JSON
+        fprintf(stderr, "Error: Failed to load image: %s\n", filename);
+        fprintf(stderr, "stbi_error: %s\n", stbi_failure_reason());  // This prints a more detailed error message
 
         return 0; // Failed to load the image
     }
@@ -44,23 +82,13 @@ int Graphics_loadImage(const char *filename, u32 **pixels, int *width, int *heig
 
     if (*pixels == NULL) 
     {
-        printf("Error: Failed to allocate memory for pixel data.\n");
+        fprintf(stderr, "Error: Failed to allocate memory for pixel data.\n");
         stbi_image_free(data);
         return 0; // Memory allocation failed
     }
 
     // Convert from 8-bit RGBA to 32-bit format (u32 = 0xAARRGGBB)
-    for (int y = 0; y < *height; y++) 
-    {
-        for (int x = 0; x < *width; x++) 
-        {
-            int idx = (y * *width + x) * 4;
-            
-            u32 pixel = (data[idx + 3] << 24) | (data[idx + 0] << 16) | (data[idx + 1] << 8) | data[idx + 2];
-            
-            (*pixels)[y * (*width) + x] = pixel;
-        }
-    }
+    Span_swizzleRB(*pixels, (const u32*) data, (size_t)(*width) * (*height));
 
     // Free the raw image data
     stbi_image_free(data);
@@ -76,6 +104,8 @@ void Graphics_setPixel(FrameBuffer buffer, i32 x, i32 y, u32 color)
 
 FrameBuffer Graphics_createColorBuffer(u32 w, u32 h)
 {
+    TRACE_FUNCTION();
+
     FrameBuffer result = {};
     result.buffer = (u32*) malloc(w * h * sizeof(u32));
 
@@ -87,148 +117,250 @@ FrameBuffer Graphics_createColorBuffer(u32 w, u32 h)
     result.width = w;
     result.height = h;
     
-    SDL_memset(result.buffer, 0, w * h * sizeof(u32));
+    memset(result.buffer, 0, w * h * sizeof(u32));
 
     return result;
 }
 
+void Graphics_createDepthBuffer(FrameBuffer &buffer)
+{
+    DepthBuffer *depth = (DepthBuffer*) malloc(sizeof(DepthBuffer));
+
+    depth->blocksX = (buffer.width + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+    depth->blocksY = (buffer.height + DEPTH_BLOCK_SIZE - 1) / DEPTH_BLOCK_SIZE;
+    depth->tilesX = (buffer.width + DEPTH_TILE_SIZE - 1) / DEPTH_TILE_SIZE;
+    depth->tilesY = (buffer.height + DEPTH_TILE_SIZE - 1) / DEPTH_TILE_SIZE;
+
+    depth->depth = (float*) malloc((size_t) buffer.width * buffer.height * sizeof(float));
+    depth->blockMin = (float*) malloc(depth->blocksX * depth->blocksY * sizeof(float));
+    depth->blockMax = (float*) malloc(depth->blocksX * depth->blocksY * sizeof(float));
+    depth->tileMax = (float*) malloc(depth->tilesX * depth->tilesY * sizeof(float));
+
+    buffer.depth = depth;
+    Graphics_clearDepthBuffer(buffer, DEPTH_FAR);
+}
+
+void Graphics_clearDepthBuffer(FrameBuffer &buffer, float depth)
+{
+    TRACE_FUNCTION();
+
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_clearDepth(buffer, full, depth);
+}
+
+void Graphics_destroyColorBuffer(FrameBuffer &buffer)
+{
+    if(buffer.depth)
+    {
+        free(buffer.depth->depth);
+        free(buffer.depth->blockMin);
+        free(buffer.depth->blockMax);
+        free(buffer.depth->tileMax);
+        free(buffer.depth);
+        buffer.depth = nullptr;
+    }
+
+    free(buffer.buffer);
+
+    buffer.buffer = nullptr;
+    buffer.width = 0;
+    buffer.height = 0;
+}
+
 void Graphics_clearFrameBuffer(FrameBuffer &buffer, u32 color)
 {
-   for(int i = 0; i < buffer.width * buffer.height; i++)
-   {
-    buffer.buffer[i] = color;
-   }
+    TRACE_FUNCTION();
+
+    // Dispatched to the widest streaming-store kernel the CPU supports
+    Simd_clear(buffer.buffer, (size_t) buffer.width * buffer.height, color);
 }
 
 // Draws a line between two points using Bresenham's line algorithm
 void Graphics_drawLine(FrameBuffer buffer, i32 x0, i32 y0, i32 x1, i32 y1, u32 color) 
 {
-    i32 dx = abs(x1 - x0);
-    i32 dy = abs(y1 - y0);
-    i32 sx = x0 < x1 ? 1 : -1;
-    i32 sy = y0 < y1 ? 1 : -1;
-    i32 err = dx - dy;
+    TRACE_FUNCTION();
 
-    while (true) 
-    {
-        Graphics_setPixel(buffer, x0, y0, color); // Draw pixel
-        if (x0 == x1 && y0 == y1) break;
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_line(buffer, x0, y0, x1, y1, full, color);
+}
 
-        i32 e2 = 2 * err;
-        if (e2 > -dy) 
-        {
-            err -= dy;
-            x0 += sx;
-        }
+// Batched lines, each clipped to the screen before it is walked
+void Graphics_drawLines(FrameBuffer &buffer, const LineSegment *lines, u32 count)
+{
+    TRACE_FUNCTION();
 
-        if (e2 < dx) 
-        {
-            err += dx;
-            y0 += sy;
-        }
-    }
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_lines(buffer, lines, count, full);
 }
 
 void Graphics_drawBackgroundGrid(FrameBuffer &buffer, i32 step, GRID_MODE mode)
 {
-    const u32 WHITE = 0xFFFFFFFF;
-    const u32 LIGHT_GRAY = 0xFFCCCCCC;
-    const u32 DARK_GRAY = 0xFF404040;
-    
-    for(int x = 0; x < buffer.width; x++)
+    TRACE_FUNCTION();
+
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_grid(buffer, step, mode, full);
+}
+
+// Clear and grid in one pass, copied from a layer cached per (step, mode, color, size)
+void Graphics_drawBackground(FrameBuffer &buffer, u32 color, i32 step, GRID_MODE mode)
+{
+    TRACE_FUNCTION();
+
+    // Drawn right away, so the layer needs no pin
+    GridLayer *layer = Layer_grid(step, mode, color, buffer.width, buffer.height, false);
+
+    if(!layer)
     {
-        for(int y = 0; y < buffer.height; y++)
-        {
-            if(mode == LINES)
-            {
-                if(x % step == 0 || y % step == 0)
-                    Graphics_setPixel(buffer, x, y, DARK_GRAY);
-            }
-            else
-            {
-                if(x % step == 0 && y % step == 0)
-                    Graphics_setPixel(buffer, x, y, WHITE);
-            }
-        }
+        Graphics_clearFrameBuffer(buffer, color);
+        Graphics_drawBackgroundGrid(buffer, step, mode);
+        return;
     }
+
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Layer_drawGrid(buffer, *layer, full);
 }
 
 void Graphics_drawRectangle(FrameBuffer &buffer, i32 x0, i32 y0, i32 w, i32 h,
      u32 color, RECT_MODE mode)
 {
-    for(int x = x0; x <= x0 + w; x++)
+    TRACE_FUNCTION();
+
+    // Both edges are inclusive, x0 + w and y0 + h are drawn
+    RasterRect rect = {x0, y0, x0 + w + 1, y0 + h + 1};
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+
+    if(mode == FILL)
+        Raster_fillRect(buffer, rect, full, color);
+    else
+        Raster_outlineRect(buffer, rect, full, color);
+}
+
+// Filled triangle using half-space edge functions, either winding
+void Graphics_drawTriangle(FrameBuffer &buffer, Vector2 v0, Vector2 v1, Vector2 v2, u32 color)
+{
+    TRACE_FUNCTION();
+
+    TriangleSetup setup;
+    if(!Raster_setupTriangle(setup, v0, v1, v2, {CULL_NONE, WINDING_CLOCKWISE}))
+        return;
+
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_fillTriangle(buffer, setup, full, color);
+}
+
+// Filled rectangle, depth tested against and written to the depth buffer
+void Graphics_drawRectangleDepth(FrameBuffer &buffer, i32 x0, i32 y0, i32 w, i32 h, float depth, u32 color)
+{
+    TRACE_FUNCTION();
+
+    TriangleSetup setup;
+    RasterRect rect = {x0, y0, x0 + w + 1, y0 + h + 1};
+    Raster_setupRectangle(setup, rect, depth);
+
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_fillTriangle(buffer, setup, full, color);
+}
+
+// x and y are screen coordinates, z is the depth interpolated across the triangle
+void Graphics_drawTriangleDepth(FrameBuffer &buffer, Vector3 v0, Vector3 v1, Vector3 v2, u32 color)
+{
+    TRACE_FUNCTION();
+
+    TriangleSetup setup;
+    if(!Raster_setupTriangleDepth(setup, v0, v1, v2, {CULL_NONE, WINDING_CLOCKWISE}))
+        return;
+
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_fillTriangle(buffer, setup, full, color);
+}
+
+// Drawing straight into the surface needs its exact layout: 0xAARRGGBB (or
+// XRGB) pixels, rows packed back to back and memory that stays put unlocked
+static PRESENT_MODE Graphics_presentMode(SDL_Surface *surface, u32 w, u32 h)
+{
+    Uint32 format = surface->format->format;
+
+    if(format == SDL_PIXELFORMAT_ARGB8888 || format == SDL_PIXELFORMAT_RGB888)
     {
-        for(int y = y0; y <= y0 + h; y++)
-        {
-            if(mode == FILL)
-                Graphics_setPixel(buffer, x, y, color);
-            else
-            {   
-                bool yCondition1 = y >= y0 && y <= y0 + h;
-                bool xCondition1 = x == x0 || x == x0 + w;
-                bool yCondition2 = y == y0 || y == y0 + h;
-                bool xCondition2 = x >= x0 && x <= x0 + w;
-                if(xCondition1 && yCondition1 || xCondition2 && yCondition2) 
-                    Graphics_setPixel(buffer, x, y, color);
-            }
-        }   
+        bool packed = surface->pitch == (int)(w * sizeof(u32)) && surface->w == (int) w && surface->h == (int) h;
+        return packed && !SDL_MUSTLOCK(surface) ? PRESENT_DIRECT : PRESENT_COPY;
     }
+
+    if(format == SDL_PIXELFORMAT_ABGR8888 || format == SDL_PIXELFORMAT_BGR888)
+        return PRESENT_SWIZZLE;
+
+    return PRESENT_CONVERT;
 }
 
 void Graphics_blitColorBufferToWindow(SDL_Window *window, SDL_Surface *windowSurface,
      FrameBuffer &buffer)
 {
-    memcpy(windowSurface->pixels, buffer.buffer, buffer.width * buffer.height * sizeof(u32));
+    TRACE_FUNCTION();
+
+    if(presentMode != PRESENT_DIRECT)
+    {
+        if(SDL_MUSTLOCK(windowSurface))
+            SDL_LockSurface(windowSurface);
+
+        u32 w = buffer.width < (u32) windowSurface->w ? buffer.width : (u32) windowSurface->w;
+        u32 h = buffer.height < (u32) windowSurface->h ? buffer.height : (u32) windowSurface->h;
+        u8 *pixels = (u8*) windowSurface->pixels;
+
+        if(presentMode == PRESENT_CONVERT)
+        {
+            SDL_ConvertPixels(w, h, SDL_PIXELFORMAT_ARGB8888, buffer.buffer, buffer.width * sizeof(u32),
+                              windowSurface->format->format, pixels, windowSurface->pitch);
+        }
+        else
+        {
+            for(u32 y = 0; y < h; y++)
+            {
+                u32 *dst = (u32*)(pixels + (size_t) y * windowSurface->pitch);
+                const u32 *src = buffer.buffer + (size_t) y * buffer.width;
+
+                if(presentMode == PRESENT_SWIZZLE)
+                    Span_swizzleRB(dst, src, w);
+                else
+                    memcpy(dst, src, w * sizeof(u32));
+            }
+        }
+
+        if(SDL_MUSTLOCK(windowSurface))
+            SDL_UnlockSurface(windowSurface);
+    }
+
     SDL_UpdateWindowSurface(window);
 }
 
 void Graphics_blitImageToBuffer(FrameBuffer &buffer, u32 *imgPixels, int imgW,
-     int imgH, int x, int y, int w, int h)
+     int imgH, int x, int y, int w, int h, BLIT_MODE mode)
 {
-    // Ensure the destination area doesn't go beyond the framebuffer boundaries
-    int destX = x;
-    int destY = y;
-    int destW = w;
-    int destH = h;
+    TRACE_FUNCTION();
 
-    if (destX < 0) 
-    {
-        destW += destX; // Adjust width if x is out of bounds
-        destX = 0;
-    }
-    if (destY < 0) 
-    {
-        destH += destY; // Adjust height if y is out of bounds
-        destY = 0;
-    }
-    if (destX + destW > buffer.width) 
-    {
-        destW = buffer.width - destX; // Ensure we don't go beyond the right edge
-    }
-    if (destY + destH > buffer.height) 
-    {
-        destH = buffer.height - destY; // Ensure we don't go beyond the bottom edge
-    }
+    // The destination is cut to the framebuffer, the image is not cropped to match
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_blit(buffer, imgPixels, imgW, imgH, x, y, w, h, mode, full);
+}
 
-    // Blit pixels from the image to the framebuffer
-    for (int j = 0; j < destH; ++j) 
-    {
-        for (int i = 0; i < destW; ++i) 
-        {
-            int imgX = i * imgW / w; // Map the destination pixel to the image pixel
-            int imgY = j * imgH / h; // Map the destination pixel to the image pixel
+// Graphics_loadImage keeps straight alpha, BLIT_BLEND expects it premultiplied
+void Graphics_premultiplyImage(u32 *pixels, int width, int height)
+{
+    Span_premultiply(pixels, pixels, (size_t) width * height);
+}
 
-            // Get the color from the image at (imgX, imgY)
-            u32 pixelColor = imgPixels[imgY * imgW + imgX];
+void Graphics_blitTexture(FrameBuffer &buffer, const Texture &texture, int x, int y, int w, int h, TEXTURE_FILTER filter)
+{
+    TRACE_FUNCTION();
 
-            // Copy the color to the framebuffer at the destination position
-            buffer.buffer[(destY + j) * buffer.width + (destX + i)] = pixelColor;
-        }
-    }
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    Raster_blitTexture(buffer, texture, x, y, w, h, filter, full);
 }
 
 void Graphics_initializeWindow()
 {
+    Simd_initialize();
+    Jobs_initialize(renderThreads);
+
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) 
     {
@@ -241,6 +373,10 @@ void Graphics_initializeWindow()
     
     windowWidth = displayMode.w;
     windowHeight = displayMode.h;
+
+    // SDL's window surface has no vsync, frames are paced to the refresh rate instead
+    if(targetFrameRate == 0)
+        targetFrameRate = displayMode.refresh_rate > 0 ? displayMode.refresh_rate : 60;
     
     // Create a window
     window = SDL_CreateWindow("3D Rasterizer", 
@@ -255,32 +391,157 @@ void Graphics_initializeWindow()
         return;
     }
 
+    windowSurface = SDL_GetWindowSurface(window);
+    if (windowSurface == NULL)
+    {
+        printf("Window surface could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        window = nullptr;
+        return;
+    }
+
+    // The renderer draws into the surface itself when its layout allows,
+    // otherwise into its own buffer that is copied at present. Pipelined
+    // frames are drawn while the surface shows the previous one, so they
+    // always go through the copy.
+    presentMode = Graphics_presentMode(windowSurface, windowWidth, windowHeight);
+    pipelineFrames = pipelineFrames && Jobs_workerCount() > 1;
+
+    if(pipelineFrames)
+    {
+        if(presentMode == PRESENT_DIRECT)
+            presentMode = PRESENT_COPY;
+
+        Frames_initialize(windowWidth, windowHeight);
+        buffer = Frames_back();
+    }
+    else if(presentMode == PRESENT_DIRECT)
+    {
+        buffer = {};
+        buffer.buffer = (u32*) windowSurface->pixels;
+        buffer.width = windowWidth;
+        buffer.height = windowHeight;
+    }
+    else
+    {
+        buffer = Graphics_createColorBuffer(windowWidth, windowHeight);
+    }
+
+    if(!pipelineFrames)
+        Graphics_createDepthBuffer(buffer);
+
+    Graphics_initializeScene();
+}
+
+// Offscreen setup for machines without a display, no SDL call is made
+void Graphics_initializeHeadless(u32 w, u32 h)
+{
+    windowWidth = w;
+    windowHeight = h;
+
+    window = nullptr;
+    windowSurface = nullptr;
+    presentMode = PRESENT_COPY;
+
+    Simd_initialize();
+    Jobs_initialize(renderThreads);
+
+    // Allow re-initializing at a different resolution
+    Graphics_destroyColorBuffer(buffer);
     buffer = Graphics_createColorBuffer(windowWidth, windowHeight);
+    Graphics_createDepthBuffer(buffer);
 
-     // Directly access the window surface and copy the color buffer
-    windowSurface = SDL_GetWindowSurface(window);
+    Graphics_initializeScene();
+}
 
+void Graphics_initializeScene()
+{
     // Initialize the Cloud of Points (Position Vectors)
-    int pointCount = 0;
- 
-    for(float x = -1; x <= 1.0; x += 0.25f)
+    if(!cloudOfPoints.positions.x && !Mesh_load(sceneMeshPath, cloudOfPoints))
     {
-        for(float y = -1; y <= 1.0f; y += 0.25f)
+        cloudOfPoints.positions = Vertex_createStream(M_POINTS);
+
+        u32 pointCount = 0;
+
+        for(float x = -1; x <= 1.0; x += 0.25f)
         {
-            for(float z = -1; z <= 1.0f; z += 0.25f)
+            for(float y = -1; y <= 1.0f; y += 0.25f)
             {
-                Vector3 newPoint = {x, y, z};
-
-                cloudOfPoints[pointCount++] = newPoint;
+                for(float z = -1; z <= 1.0f; z += 0.25f)
+                {
+                    cloudOfPoints.positions.x[pointCount] = x;
+                    cloudOfPoints.positions.y[pointCount] = y;
+                    cloudOfPoints.positions.z[pointCount] = z;
+                    pointCount++;
+                }
             }
         }
+
+        cloudOfPoints.positions.count = pointCount;
+        cloudOfPoints.vertexCount = pointCount;
+        Mesh_computeBounds(cloudOfPoints);
+    }
+
+    if(!projectedPoints.x)
+    {
+        projectedPoints = Vertex_createProjected(cloudOfPoints.vertexCount);
+        visiblePoints = (u32*) Vertex_alignedAlloc((size_t) cloudOfPoints.vertexCount * sizeof(u32));
+    }
+
+    if(!meshVertices.x && cloudOfPoints.triangleCount)
+        meshVertices = Clip_createVertexBuffer(cloudOfPoints.vertexCount);
+
+    if(cloudNode == SCENE_NONE)
+        cloudNode = Scene_addNode(sceneGraph, SCENE_NONE);
+
+    if(!image.pixels)
+        Texture_load("./res/t.jpeg", image, LAYOUT_LINEAR);
+}
+
+// Stops the render workers before static destruction and releases the window
+void Graphics_shutdown()
+{
+    Jobs_shutdown();
+
+    // A direct FrameBuffer borrows the surface's pixels, SDL frees those.
+    // Pipelined ones belong to the frame exchange.
+    if(window && pipelineFrames)
+    {
+        buffer = {};
+        Frames_shutdown();
+    }
+    else if(presentMode == PRESENT_DIRECT)
+    {
+        buffer.buffer = nullptr;
     }
 
-    Graphics_loadImage("./res/t.jpeg", &pixels, &w, &h);
+    Graphics_destroyColorBuffer(buffer);
+    Mesh_free(cloudOfPoints);
+    Clip_destroyVertexBuffer(meshVertices);
+    Scene_clear(sceneGraph);
+    cloudNode = SCENE_NONE;
+    Vertex_destroyProjected(projectedPoints);
+    Vertex_alignedFree(visiblePoints);
+    visiblePoints = nullptr;
+    Layer_shutdown();
+    Texture_free(image);
+
+    if(window)
+    {
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        window = nullptr;
+    }
 }
 
 void Graphics_processInput()
 {
+    TRACE_FUNCTION();
+
+    // Nothing to poll when rendering offscreen
+    if(!window) return;
+
     SDL_Event e;
 
     // Handle events
@@ -298,22 +559,48 @@ void Graphics_processInput()
     }
 }
 
+// One fixed step of the scene's simulation. The point cloud is static, so
+// only the clock advances.
+void Graphics_simulate(double seconds)
+{
+    simulationTime += seconds;
+}
+
 void Graphics_update()
 {
-    for(int i = 0; i < M_POINTS; i++)
-    {
-        Vector3 point = cloudOfPoints[i];
+    TRACE_FUNCTION();
+
+    Scene_update(sceneGraph);
 
-        point.z -= cameraPosition.z;
+    // Model, view and projection composed once per frame
+    Matrix4 view = Math_translation(-cameraPosition.x, -cameraPosition.y, -cameraPosition.z);
+    Matrix4 projection = Math_screenProjection(fovFactor, windowWidth/2.0f, windowHeight/2.0f);
+    Matrix4 modelViewProjection = Math_multiply(Math_multiply(projection, view), Scene_world(sceneGraph, cloudNode));
 
-        // Screen Space Coordinate
-        Vector2 projectedPoint = Graphics_project(point, PERSPECTIVE);
+    Clip_resetStats();
 
-        projectedPoint.x += windowWidth/2.0f;
-        projectedPoint.y += windowHeight/2.0f;
+    // Points whose rectangle can touch the screen, in front of the near plane
+    ClipVolume volume = Clip_screenVolume((float) buffer.width, (float) buffer.height, (float) POINT_SIZE, CLIP_NEAR);
 
-        projectedPoints[i] = projectedPoint;
+    // Whole cloud off-screen or behind the camera
+    if(Clip_cullBounds(volume, modelViewProjection, cloudOfPoints.boundsMin, cloudOfPoints.boundsMax))
+    {
+        clipStats.pointsCulled += cloudOfPoints.vertexCount;
+        projectedPoints.count = 0;
+        meshVertices.count = 0;
+        return;
     }
+
+    // Shared corners of the mesh's triangles are transformed once here,
+    // the triangles themselves are assembled while recording
+    if(cloudOfPoints.triangleCount)
+    {
+        meshVolume = Clip_screenVolume((float) buffer.width, (float) buffer.height, 0.0f, CLIP_NEAR);
+        Clip_transformVertices(meshVolume, cloudOfPoints.positions, modelViewProjection, meshVertices);
+    }
+
+    // Screen Space Coordinates for the visible points, one fused multiply per point
+    Clip_cullPoints(volume, cloudOfPoints.positions, modelViewProjection, projectedPoints, visiblePoints);
 }
 
 // Darken color based on z-value
@@ -339,30 +626,142 @@ u32 Graphics_darkenColor(u32 color, float z)
 
 void Graphics_render()
 {
-    Graphics_clearFrameBuffer(buffer, 0xFF000000);
+    TRACE_FUNCTION();
+
+    Queue_begin(frameQueue, buffer.width, buffer.height);
+
+    Queue_clear(frameQueue, 0xFF000000);
+    Queue_clearDepth(frameQueue, DEPTH_FAR);
        
-    Graphics_drawBackgroundGrid(buffer, 10, DOTS);
-    Graphics_drawRectangle(buffer, 100, 100, 20, 10, 0xFFFF0000, OUTLINE);
+    Queue_drawBackgroundGrid(frameQueue, 10, DOTS);
+    Queue_drawRectangle(frameQueue, 100, 100, 20, 10, 0xFFFF0000, OUTLINE);
+
+    Queue_drawRectangle(frameQueue, 300, 200, 300, 150, 0xFFFF00FF, FILL);
 
-    Graphics_drawRectangle(buffer, 300, 200, 300, 150, 0xFFFF00FF, FILL);
+    // OBJ front faces wind counter-clockwise, which stays counter-clockwise
+    // on screen through the y-down projection
+    if(meshVertices.count)
+    {
+        Queue_setCull(frameQueue, CULL_BACK, WINDING_COUNTER_CLOCKWISE);
+        Clip_drawIndexed(frameQueue, meshVolume, meshVertices, cloudOfPoints.indices, cloudOfPoints.triangleCount, 0xFF406080);
+        Queue_setCull(frameQueue, CULL_NONE, WINDING_CLOCKWISE);
+    }
        
     // Draw Projected Points On Screen Plane
-    for(int i = 0; i < M_POINTS; i++)
+    for(u32 i = 0; i < projectedPoints.count; i++)
     {
-        Vector2 point = projectedPoints[i];
-
         // Darken color based on z value
-        u32 color = Graphics_darkenColor(0xFFF00FFFF, cloudOfPoints[i].z);
+        u32 color = Graphics_darkenColor(0xFFF00FFFF, cloudOfPoints.positions.z[visiblePoints[i]]);
+
+        // Nearer points occlude farther ones regardless of draw order
+        Queue_drawRectangleDepth(frameQueue, (i32) projectedPoints.x[i], (i32) projectedPoints.y[i], POINT_SIZE, POINT_SIZE, projectedPoints.depth[i], color);
+    }
+
+    //Queue_blitImage(frameQueue, image.pixels, image.width, image.height, 100, 100, image.width, image.height, BLIT_COPY);
+
+    // Tiles are rasterized in parallel, a single worker draws in one pass
+    if(Jobs_workerCount() > 1)
+    {
+        Tiles_bin(frameBins, frameQueue);
+        Tiles_execute(buffer, frameQueue, frameBins);
+    }
+    else
+    {
+        Queue_execute(buffer, frameQueue);
+    }
+}
+
+// Headless frames stay in the FrameBuffer for the caller
+void Graphics_present()
+{
+    if(window)
+        Graphics_blitColorBufferToWindow(window, windowSurface, buffer);
+}
+
+// Simulation, update and render run one frame ahead on their own thread
+// while this one polls input and presents. SDL wants both of those on the
+// window's thread. Only the presenter is paced, the renderer waits for each
+// frame to be taken, so one clock drives both threads.
+void Graphics_runPipelined(FramePacer &pacer)
+{
+    std::atomic<bool> running(true);
+
+    std::thread renderer([&running]()
+    {
+        // Unpaced, it only counts simulation steps
+        FramePacer renderPacer;
+        Pacing_initialize(renderPacer, 0, SIMULATION_RATE);
+
+        while(running.load(std::memory_order_relaxed))
+        {
+            TRACE_SCOPE("frame");
+
+            u32 steps = Pacing_beginFrame(renderPacer);
+            for(u32 i = 0; i < steps; i++)
+                Graphics_simulate(Pacing_stepSeconds(renderPacer));
+
+            Graphics_update();
+            Graphics_render();
+            buffer = Frames_publish();
+
+            Frames_waitConsumed();
+        }
+    });
+
+    while(!quit)
+    {
+        Pacing_beginFrame(pacer);
+        Graphics_processInput();
+
+        FrameBuffer *frame = Frames_acquire();
+        if(frame)
+            Graphics_blitColorBufferToWindow(window, windowSurface, *frame);
+
+        Pacing_endFrame(pacer);
+    }
+
+    running.store(false, std::memory_order_relaxed);
+    Frames_stop();
+    renderer.join();
+}
+
+// Dumps the FrameBuffer as a binary PPM (P6), alpha is dropped
+int Graphics_writeFrameBufferPPM(const char *filename, FrameBuffer &buffer)
+{
+    FILE *file = fopen(filename, "wb");
+
+    if(file == NULL)
+    {
+        printf("Error: Failed to open file for writing: %s\n", filename);
+        return 0;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", buffer.width, buffer.height);
+
+    u8 *row = (u8*) malloc(buffer.width * 3);
+
+    for(u32 y = 0; y < buffer.height; y++)
+    {
+        u32 *src = buffer.buffer + y * buffer.width;
+
+        for(u32 x = 0; x < buffer.width; x++)
+        {
+            row[x * 3 + 0] = (src[x] >> 16) & 0xFF;
+            row[x * 3 + 1] = (src[x] >> 8) & 0xFF;
+            row[x * 3 + 2] = src[x] & 0xFF;
+        }
 
-        Graphics_drawRectangle(buffer, (u32) point.x, (u32) point.y, 5,5, color, FILL);
+        fwrite(row, 1, buffer.width * 3, file);
     }
 
-    //Graphics_blitImageToBuffer(buffer, pixels, w, h, 100, 100, w, h);
+    free(row);
+    fclose(file);
 
-    Graphics_blitColorBufferToWindow(window, windowSurface, buffer);
+    return 1;
 }
 
 // We are using Left-Handed Coordinates Handedness
+// Perspective assumes point.z > 0, points behind the camera are culled by the clip stage
 Vector2 Graphics_project(Vector3 point, PROJECTION_MODE mode)
 {
     Vector2 screenPosition;
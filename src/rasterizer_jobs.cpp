@@ -0,0 +1,220 @@
+#include "rasterizer_jobs.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+// Task range packed as (begin << 32 | end) so owner pops and thief
+// splits are a single compare-and-swap each
+struct alignas(64) JobRange
+{
+    std::atomic<u64> packed;
+};
+
+struct JobPool
+{
+    std::vector<std::thread> threads;
+    JobRange *ranges;
+    u32 workerCount;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    u64 generation;
+    bool stop;
+
+    JobFunction function;
+    void *context;
+
+    std::atomic<u32> remaining;
+    std::atomic<u32> busyWorkers;
+};
+
+globalVariable JobPool pool;
+
+static u64 Jobs_pack(u32 begin, u32 end)
+{
+    return ((u64) begin << 32) | end;
+}
+
+// Owner side: take the first index of its own range
+static bool Jobs_pop(JobRange &range, u32 &index)
+{
+    u64 packed = range.packed.load(std::memory_order_acquire);
+
+    while(true)
+    {
+        u32 begin = (u32)(packed >> 32);
+        u32 end = (u32) packed;
+
+        if(begin >= end)
+            return false;
+
+        if(range.packed.compare_exchange_weak(packed, Jobs_pack(begin + 1, end), std::memory_order_acq_rel))
+        {
+            index = begin;
+            return true;
+        }
+    }
+}
+
+// Thief side: move the back half of a victim's range into our own
+static bool Jobs_steal(JobRange &victim, JobRange &own)
+{
+    u64 packed = victim.packed.load(std::memory_order_acquire);
+
+    while(true)
+    {
+        u32 begin = (u32)(packed >> 32);
+        u32 end = (u32) packed;
+
+        if(begin >= end)
+            return false;
+
+        u32 mid = begin + (end - begin) / 2;
+
+        if(victim.packed.compare_exchange_weak(packed, Jobs_pack(begin, mid), std::memory_order_acq_rel))
+        {
+            // Our range is empty here, no one else will touch it until we refill
+            own.packed.store(Jobs_pack(mid, end), std::memory_order_release);
+            return true;
+        }
+    }
+}
+
+static void Jobs_work(u32 worker)
+{
+    JobRange &own = pool.ranges[worker];
+
+    while(true)
+    {
+        u32 index;
+        while(Jobs_pop(own, index))
+        {
+            pool.function(pool.context, index, worker);
+            pool.remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        bool stole = false;
+        for(u32 i = 1; i < pool.workerCount && !stole; i++)
+        {
+            JobRange &victim = pool.ranges[(worker + i) % pool.workerCount];
+            stole = Jobs_steal(victim, own);
+        }
+
+        // Every range is empty, remaining tasks are already running elsewhere
+        if(!stole)
+            return;
+    }
+}
+
+static void Jobs_workerMain(u32 worker)
+{
+    u64 seen = 0;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.wake.wait(lock, [&]() { return pool.stop || pool.generation != seen; });
+
+            if(pool.stop)
+                return;
+
+            seen = pool.generation;
+        }
+
+        Jobs_work(worker);
+        pool.busyWorkers.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void Jobs_initialize(u32 threadCount)
+{
+    Jobs_shutdown();
+
+    if(threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if(threadCount == 0)
+        threadCount = 1;
+
+    pool.workerCount = threadCount;
+    pool.ranges = new JobRange[threadCount];
+    pool.generation = 0;
+    pool.stop = false;
+
+    for(u32 i = 0; i < threadCount; i++)
+        pool.ranges[i].packed.store(0);
+
+    // Worker 0 is the thread calling Jobs_parallelFor
+    for(u32 i = 1; i < threadCount; i++)
+        pool.threads.emplace_back(Jobs_workerMain, i);
+}
+
+void Jobs_shutdown()
+{
+    if(pool.ranges == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stop = true;
+    }
+    pool.wake.notify_all();
+
+    for(std::thread &thread : pool.threads)
+        thread.join();
+
+    pool.threads.clear();
+    delete[] pool.ranges;
+    pool.ranges = nullptr;
+    pool.workerCount = 0;
+}
+
+u32 Jobs_workerCount()
+{
+    return pool.workerCount > 0 ? pool.workerCount : 1;
+}
+
+void Jobs_parallelFor(u32 count, JobFunction function, void *context)
+{
+    if(count == 0)
+        return;
+
+    if(pool.workerCount <= 1)
+    {
+        for(u32 i = 0; i < count; i++)
+            function(context, i, 0);
+        return;
+    }
+
+    pool.function = function;
+    pool.context = context;
+    pool.remaining.store(count, std::memory_order_relaxed);
+    pool.busyWorkers.store(pool.workerCount - 1, std::memory_order_relaxed);
+
+    // Even initial split, stealing evens out uneven task costs
+    for(u32 i = 0; i < pool.workerCount; i++)
+    {
+        u32 begin = (u32)((u64) count * i / pool.workerCount);
+        u32 end = (u32)((u64) count * (i + 1) / pool.workerCount);
+        pool.ranges[i].packed.store(Jobs_pack(begin, end), std::memory_order_release);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.generation++;
+    }
+    pool.wake.notify_all();
+
+    Jobs_work(0);
+
+    // Wait for in-flight tasks and for every worker to leave its steal loop,
+    // so the ranges can be reused by the next call
+    while(pool.remaining.load(std::memory_order_acquire) != 0 ||
+          pool.busyWorkers.load(std::memory_order_acquire) != 0)
+    {
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,119 @@
+#include "rasterizer_layer.h"
+#include "rasterizer_span.h"
+#include "rasterizer_vertex.h"
+#include "rasterizer_trace.h"
+
+#include <string.h>
+
+globalVariable GridLayer gridLayers[LAYER_GRID_CACHE_SIZE];
+globalVariable u64 gridLayerClock;
+
+static void Layer_buildGrid(GridLayer &layer, i32 step, GRID_MODE mode, u32 background, u32 width, u32 height)
+{
+    TRACE_FUNCTION();
+
+    if(layer.pixels && layer.width != width)
+    {
+        Vertex_alignedFree(layer.pixels);
+        layer.pixels = nullptr;
+    }
+
+    if(!layer.pixels)
+        layer.pixels = (u32*) Vertex_alignedAlloc((size_t) width * 2 * sizeof(u32));
+
+    // Rows 0 and 1 of a two-row frame are the two patterns; with step 1
+    // every row is a grid row and row 1 is never read
+    FrameBuffer target = {layer.pixels, width, 2, nullptr};
+    RasterRect full = {0, 0, (i32) width, 2};
+    Span_fill(layer.pixels, (size_t) width * 2, background);
+    Raster_grid(target, step, mode, full);
+
+    layer.step = step;
+    layer.mode = mode;
+    layer.background = background;
+    layer.width = width;
+    layer.height = height;
+}
+
+GridLayer* Layer_grid(i32 step, GRID_MODE mode, u32 background, u32 width, u32 height, bool pin)
+{
+    if(step <= 0 || width == 0)
+        return nullptr;
+
+    gridLayerClock++;
+
+    // Least recently used unpinned entry is replaced on a miss, empty ones first
+    GridLayer *victim = nullptr;
+    for(u32 i = 0; i < LAYER_GRID_CACHE_SIZE; i++)
+    {
+        GridLayer &layer = gridLayers[i];
+
+        if(layer.pixels && layer.step == step && layer.mode == mode && layer.background == background &&
+           layer.width == width && layer.height == height)
+        {
+            layer.lastUse = gridLayerClock;
+            layer.pinned = layer.pinned || pin;
+            return &layer;
+        }
+
+        if(!layer.pinned && (!victim || layer.lastUse < victim->lastUse))
+            victim = &layer;
+    }
+
+    if(!victim)
+        return nullptr;
+
+    Layer_buildGrid(*victim, step, mode, background, width, height);
+    victim->lastUse = gridLayerClock;
+    victim->pinned = pin;
+    return victim;
+}
+
+void Layer_beginFrame()
+{
+    for(u32 i = 0; i < LAYER_GRID_CACHE_SIZE; i++)
+        gridLayers[i].pinned = false;
+}
+
+void Layer_drawGrid(FrameBuffer &buffer, const GridLayer &layer, RasterRect clip)
+{
+    RasterRect screen = {0, 0, (i32) layer.width, (i32) layer.height};
+    RasterRect target = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    RasterRect r = Raster_intersectRect(Raster_intersectRect(clip, screen), target);
+
+    if(r.minX >= r.maxX || r.minY >= r.maxY)
+        return;
+
+    size_t count = r.maxX - r.minX;
+    const u32 *onRow = layer.pixels + r.minX;
+    const u32 *offRow = layer.pixels + layer.width + r.minX;
+
+    // Whole frames bypass the cache like Simd_clear, tiles stay cached for
+    // the commands drawn over them
+    bool stream = count * (r.maxY - r.minY) * sizeof(u32) >= SPAN_STREAM_THRESHOLD;
+
+    for(i32 y = r.minY; y < r.maxY; y++)
+    {
+        u32 *row = buffer.buffer + (size_t) y * buffer.width + r.minX;
+        const u32 *pattern = y % layer.step == 0 ? onRow : offRow;
+
+        if(stream)
+            Span_copyStream(row, pattern, count);
+        else
+            memcpy(row, pattern, count * sizeof(u32));
+    }
+
+    if(stream)
+        Span_streamFence();
+}
+
+void Layer_shutdown()
+{
+    for(u32 i = 0; i < LAYER_GRID_CACHE_SIZE; i++)
+    {
+        Vertex_alignedFree(gridLayers[i].pixels);
+        gridLayers[i] = {};
+    }
+
+    gridLayerClock = 0;
+}
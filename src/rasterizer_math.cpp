@@ -1,2 +1,385 @@
 #include "rasterizer_math.h"
+#include "rasterizer_simd.h"
 
+#include <math.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+const float DEGREES_TO_RADIANS = 3.14159265358979f / 180.0f;
+
+static Vector3 Math_subtract3(Vector3 a, Vector3 b)
+{
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static float Math_dot3(Vector3 a, Vector3 b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3 Math_cross3(Vector3 a, Vector3 b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+static Vector3 Math_normalize3(Vector3 v)
+{
+    float length = sqrtf(Math_dot3(v, v));
+    if(length == 0.0f) return v;
+
+    return {v.x / length, v.y / length, v.z / length};
+}
+
+Matrix4 Math_identity()
+{
+    Matrix4 result = {};
+    result.m[0][0] = 1.0f;
+    result.m[1][1] = 1.0f;
+    result.m[2][2] = 1.0f;
+    result.m[3][3] = 1.0f;
+    return result;
+}
+
+Matrix4 Math_translation(float x, float y, float z)
+{
+    Matrix4 result = Math_identity();
+    result.m[3][0] = x;
+    result.m[3][1] = y;
+    result.m[3][2] = z;
+    return result;
+}
+
+Matrix4 Math_scale(float x, float y, float z)
+{
+    Matrix4 result = {};
+    result.m[0][0] = x;
+    result.m[1][1] = y;
+    result.m[2][2] = z;
+    result.m[3][3] = 1.0f;
+    return result;
+}
+
+Matrix4 Math_rotationX(float radians)
+{
+    float c = cosf(radians);
+    float s = sinf(radians);
+
+    Matrix4 result = Math_identity();
+    result.m[1][1] = c;
+    result.m[1][2] = s;
+    result.m[2][1] = -s;
+    result.m[2][2] = c;
+    return result;
+}
+
+Matrix4 Math_rotationY(float radians)
+{
+    float c = cosf(radians);
+    float s = sinf(radians);
+
+    Matrix4 result = Math_identity();
+    result.m[0][0] = c;
+    result.m[0][2] = -s;
+    result.m[2][0] = s;
+    result.m[2][2] = c;
+    return result;
+}
+
+Matrix4 Math_rotationZ(float radians)
+{
+    float c = cosf(radians);
+    float s = sinf(radians);
+
+    Matrix4 result = Math_identity();
+    result.m[0][0] = c;
+    result.m[0][1] = s;
+    result.m[1][0] = -s;
+    result.m[1][1] = c;
+    return result;
+}
+
+Matrix4 Math_rotationEuler(Vector3 degrees)
+{
+    Matrix4 rotation = Math_rotationZ(degrees.z * DEGREES_TO_RADIANS);
+    rotation = Math_multiply(Math_rotationX(degrees.x * DEGREES_TO_RADIANS), rotation);
+    rotation = Math_multiply(Math_rotationY(degrees.y * DEGREES_TO_RADIANS), rotation);
+    return rotation;
+}
+
+Matrix4 Math_model(Vector3 position, Vector3 rotation, Vector3 scale)
+{
+    Matrix4 model = Math_scale(scale.x, scale.y, scale.z);
+    model = Math_multiply(Math_rotationEuler(rotation), model);
+    model = Math_multiply(Math_translation(position.x, position.y, position.z), model);
+    return model;
+}
+
+// x right, y down the screen, z into it; up is the world direction
+// that should appear at the top of the screen
+Matrix4 Math_lookAt(Vector3 eye, Vector3 target, Vector3 up)
+{
+    Vector3 forward = Math_normalize3(Math_subtract3(target, eye));
+    Vector3 right = Math_normalize3(Math_cross3(forward, up));
+    Vector3 down = Math_cross3(forward, right);
+
+    Matrix4 result = Math_identity();
+    result.m[0][0] = right.x;   result.m[1][0] = right.y;   result.m[2][0] = right.z;
+    result.m[0][1] = down.x;    result.m[1][1] = down.y;    result.m[2][1] = down.z;
+    result.m[0][2] = forward.x; result.m[1][2] = forward.y; result.m[2][2] = forward.z;
+
+    result.m[3][0] = -Math_dot3(right, eye);
+    result.m[3][1] = -Math_dot3(down, eye);
+    result.m[3][2] = -Math_dot3(forward, eye);
+    return result;
+}
+
+// Inverse of the camera's placement, the rotation part is orthonormal
+Matrix4 Math_view(Camera &camera)
+{
+    Matrix4 rotation = Math_transpose(Math_rotationEuler(camera.rotation));
+    Matrix4 translation = Math_translation(-camera.position.x, -camera.position.y, -camera.position.z);
+    return Math_multiply(rotation, translation);
+}
+
+Matrix4 Math_perspective(float fovY, float aspect, float zNear, float zFar)
+{
+    float focal = 1.0f / tanf(fovY * 0.5f);
+    float range = zFar / (zFar - zNear);
+
+    Matrix4 result = {};
+    result.m[0][0] = focal / aspect;
+    result.m[1][1] = focal;
+    result.m[2][2] = range;
+    result.m[2][3] = 1.0f;
+    result.m[3][2] = -zNear * range;
+    return result;
+}
+
+Matrix4 Math_orthographic(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+    Matrix4 result = Math_identity();
+    result.m[0][0] = 2.0f / (right - left);
+    result.m[1][1] = 2.0f / (top - bottom);
+    result.m[2][2] = 1.0f / (zFar - zNear);
+    result.m[3][0] = -(right + left) / (right - left);
+    result.m[3][1] = -(top + bottom) / (top - bottom);
+    result.m[3][2] = -zNear / (zFar - zNear);
+    return result;
+}
+
+// x' = fov * x + cx * z, y' = fov * y + cy * z, z' = w' = z
+Matrix4 Math_screenProjection(float fovFactor, float centerX, float centerY)
+{
+    Matrix4 result = {};
+    result.m[0][0] = fovFactor;
+    result.m[1][1] = fovFactor;
+    result.m[2][0] = centerX;
+    result.m[2][1] = centerY;
+    result.m[2][2] = 1.0f;
+    result.m[2][3] = 1.0f;
+    return result;
+}
+
+Matrix4 Math_transpose(const Matrix4 &matrix)
+{
+    Matrix4 result;
+    for(int c = 0; c < 4; c++)
+    {
+        for(int r = 0; r < 4; r++)
+            result.m[c][r] = matrix.m[r][c];
+    }
+    return result;
+}
+
+#ifdef SIMD_X86
+
+// SSE2 is part of the x86-64 baseline, so these need no runtime dispatch
+
+static inline __m128 Math_transformColumns(const Matrix4 &matrix, __m128 v)
+{
+    __m128 result = _mm_mul_ps(_mm_load_ps(matrix.m[0]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_load_ps(matrix.m[1]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_load_ps(matrix.m[2]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_load_ps(matrix.m[3]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+    return result;
+}
+
+Matrix4 Math_multiply(const Matrix4 &a, const Matrix4 &b)
+{
+    Matrix4 result;
+    for(int c = 0; c < 4; c++)
+        _mm_store_ps(result.m[c], Math_transformColumns(a, _mm_load_ps(b.m[c])));
+    return result;
+}
+
+Vector4 Math_transform(const Matrix4 &matrix, Vector4 v)
+{
+    Vector4 result;
+    _mm_store_ps(&result.x, Math_transformColumns(matrix, _mm_load_ps(&v.x)));
+    return result;
+}
+
+void Math_transformBatch(const Matrix4 &matrix, const Vector4 *in, Vector4 *out, size_t count)
+{
+    __m128 c0 = _mm_load_ps(matrix.m[0]);
+    __m128 c1 = _mm_load_ps(matrix.m[1]);
+    __m128 c2 = _mm_load_ps(matrix.m[2]);
+    __m128 c3 = _mm_load_ps(matrix.m[3]);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        __m128 v = _mm_load_ps(&in[i].x);
+        __m128 result = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+        result = _mm_add_ps(result, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+        result = _mm_add_ps(result, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+        result = _mm_add_ps(result, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm_store_ps(&out[i].x, result);
+    }
+}
+
+// 2x2 blocks packed as (m00, m01, m10, m11)
+static inline __m128 Math_mat2Multiply(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// adjugate(a) * b
+static inline __m128 Math_mat2AdjugateMultiply(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+// a * adjugate(b)
+static inline __m128 Math_mat2MultiplyAdjugate(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// Blockwise inverse over the four 2x2 sub-matrices. Works on columns the
+// same way as on rows, since inverse(transpose(M)) = transpose(inverse(M)).
+bool Math_inverse(const Matrix4 &matrix, Matrix4 &result)
+{
+    __m128 c0 = _mm_load_ps(matrix.m[0]);
+    __m128 c1 = _mm_load_ps(matrix.m[1]);
+    __m128 c2 = _mm_load_ps(matrix.m[2]);
+    __m128 c3 = _mm_load_ps(matrix.m[3]);
+
+    __m128 a = _mm_movelh_ps(c0, c1);
+    __m128 b = _mm_movehl_ps(c1, c0);
+    __m128 c = _mm_movelh_ps(c2, c3);
+    __m128 d = _mm_movehl_ps(c3, c2);
+
+    // Determinants of a, b, c and d in one pass
+    __m128 detSub = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+
+    __m128 detA = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 detB = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 detC = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 detD = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(3, 3, 3, 3));
+
+    __m128 dc = Math_mat2AdjugateMultiply(d, c);
+    __m128 ab = Math_mat2AdjugateMultiply(a, b);
+
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), Math_mat2Multiply(b, dc));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), Math_mat2Multiply(c, ab));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), Math_mat2MultiplyAdjugate(d, ab));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), Math_mat2MultiplyAdjugate(a, dc));
+
+    // det(M) = det(a)det(d) + det(b)det(c) - trace(adj(a)b * adj(d)c)
+    __m128 trace = _mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0)));
+    trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(2, 3, 0, 1)));
+    trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+
+    float determinant = _mm_cvtss_f32(det);
+    if(determinant == 0.0f || !isfinite(determinant))
+        return false;
+
+    __m128 reciprocal = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    x = _mm_mul_ps(x, reciprocal);
+    y = _mm_mul_ps(y, reciprocal);
+    z = _mm_mul_ps(z, reciprocal);
+    w = _mm_mul_ps(w, reciprocal);
+
+    _mm_store_ps(result.m[0], _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(result.m[1], _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_store_ps(result.m[2], _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_store_ps(result.m[3], _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+    return true;
+}
+
+#else
+
+Matrix4 Math_multiply(const Matrix4 &a, const Matrix4 &b)
+{
+    Matrix4 result;
+    for(int c = 0; c < 4; c++)
+    {
+        for(int r = 0; r < 4; r++)
+        {
+            result.m[c][r] = a.m[0][r] * b.m[c][0] + a.m[1][r] * b.m[c][1] +
+                             a.m[2][r] * b.m[c][2] + a.m[3][r] * b.m[c][3];
+        }
+    }
+    return result;
+}
+
+Vector4 Math_transform(const Matrix4 &matrix, Vector4 v)
+{
+    Vector4 result;
+    result.x = matrix.m[0][0] * v.x + matrix.m[1][0] * v.y + matrix.m[2][0] * v.z + matrix.m[3][0] * v.w;
+    result.y = matrix.m[0][1] * v.x + matrix.m[1][1] * v.y + matrix.m[2][1] * v.z + matrix.m[3][1] * v.w;
+    result.z = matrix.m[0][2] * v.x + matrix.m[1][2] * v.y + matrix.m[2][2] * v.z + matrix.m[3][2] * v.w;
+    result.w = matrix.m[0][3] * v.x + matrix.m[1][3] * v.y + matrix.m[2][3] * v.z + matrix.m[3][3] * v.w;
+    return result;
+}
+
+void Math_transformBatch(const Matrix4 &matrix, const Vector4 *in, Vector4 *out, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+        out[i] = Math_transform(matrix, in[i]);
+}
+
+// Cofactor expansion along the first column
+bool Math_inverse(const Matrix4 &matrix, Matrix4 &result)
+{
+    const float *m = &matrix.m[0][0];
+    float inv[16];
+
+    inv[0]  =  m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4]  = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8]  =  m[4]*m[9]*m[15]  - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14]  + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1]  = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5]  =  m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9]  = -m[0]*m[9]*m[15]  + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] =  m[0]*m[9]*m[14]  - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2]  =  m[1]*m[6]*m[15]  - m[1]*m[7]*m[14]  - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7]  - m[13]*m[3]*m[6];
+    inv[6]  = -m[0]*m[6]*m[15]  + m[0]*m[7]*m[14]  + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7]  + m[12]*m[3]*m[6];
+    inv[10] =  m[0]*m[5]*m[15]  - m[0]*m[7]*m[13]  - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7]  - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14]  + m[0]*m[6]*m[13]  + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6]  + m[12]*m[2]*m[5];
+    inv[3]  = -m[1]*m[6]*m[11]  + m[1]*m[7]*m[10]  + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7]   + m[9]*m[3]*m[6];
+    inv[7]  =  m[0]*m[6]*m[11]  - m[0]*m[7]*m[10]  - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7]   - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11]  + m[0]*m[7]*m[9]   + m[4]*m[1]*m[11] - m[4]*m[3]*m[9]  - m[8]*m[1]*m[7]   + m[8]*m[3]*m[5];
+    inv[15] =  m[0]*m[5]*m[10]  - m[0]*m[6]*m[9]   - m[4]*m[1]*m[10] + m[4]*m[2]*m[9]  + m[8]*m[1]*m[6]   - m[8]*m[2]*m[5];
+
+    float determinant = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if(determinant == 0.0f || !isfinite(determinant))
+        return false;
+
+    float reciprocal = 1.0f / determinant;
+    float *out = &result.m[0][0];
+    for(int i = 0; i < 16; i++)
+        out[i] = inv[i] * reciprocal;
+    return true;
+}
+
+#endif
@@ -0,0 +1,834 @@
+#include "rasterizer_mesh.h"
+#include "rasterizer_jobs.h"
+#include "rasterizer_trace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+enum OBJ_STATEMENT
+{
+    OBJ_OTHER,
+    OBJ_POSITION,
+    OBJ_UV,
+    OBJ_NORMAL,
+    OBJ_FACE
+};
+
+// Statement counts of a chunk, then where its statements start in the
+// whole file once the counts are summed
+struct ObjChunk
+{
+    const char *begin;
+    const char *end;
+
+    u64 positions;
+    u64 uvs;
+    u64 normals;
+    u64 triangles;
+
+    u64 positionBase;
+    u64 uvBase;
+    u64 normalBase;
+    u64 triangleBase;
+
+    bool invalid;
+};
+
+struct ObjParse
+{
+    ObjChunk *chunks;
+    u64 positionCount;
+    u64 uvCount;
+    u64 normalCount;
+
+    float *x;
+    float *y;
+    float *z;
+    float *uvs;
+    float *normals;
+
+    // Face corners, 3 per triangle. uv and normal indices only exist when
+    // the file has those statements.
+    u32 *cornerPositions;
+    u32 *cornerUVs;
+    u32 *cornerNormals;
+};
+
+const char *meshCacheDirectory = "./mesh_cache";
+
+static inline bool Mesh_isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline bool Mesh_isDigit(char c)
+{
+    return (u8)(c - '0') < 10;
+}
+
+// Comments and line ends finish a statement
+static inline bool Mesh_isEnd(const char *s, const char *end)
+{
+    return s >= end || *s == '\n' || *s == '\r' || *s == '#';
+}
+
+static inline const char *Mesh_skipSpaces(const char *s, const char *end)
+{
+    while(s < end && Mesh_isSpace(*s))
+        s++;
+
+    return s;
+}
+
+static inline const char *Mesh_nextLine(const char *s, const char *end)
+{
+    const char *newline = (const char*) memchr(s, '\n', end - s);
+    return newline ? newline + 1 : end;
+}
+
+// Kind of the statement at a line start, s is left after its keyword
+static OBJ_STATEMENT Mesh_statement(const char *&s, const char *end)
+{
+    s = Mesh_skipSpaces(s, end);
+
+    if(end - s < 2)
+        return OBJ_OTHER;
+
+    OBJ_STATEMENT statement = OBJ_OTHER;
+    size_t length = 2;
+
+    if(s[0] == 'v' && Mesh_isSpace(s[1]))
+    {
+        statement = OBJ_POSITION;
+        length = 1;
+    }
+    else if(s[0] == 'f' && Mesh_isSpace(s[1]))
+    {
+        statement = OBJ_FACE;
+        length = 1;
+    }
+    else if(s[0] == 'v' && end - s > 2 && Mesh_isSpace(s[2]))
+    {
+        if(s[1] == 't') statement = OBJ_UV;
+        if(s[1] == 'n') statement = OBJ_NORMAL;
+    }
+
+    s += length;
+    return statement;
+}
+
+// Decimal float with optional sign, fraction and exponent. Digits are
+// collected into an integer and scaled once, exact powers of ten cover
+// the usual exponents. Returns nullptr without a number.
+static const char *Mesh_parseFloat(const char *s, const char *end, float &value)
+{
+    static const double powers[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    s = Mesh_skipSpaces(s, end);
+
+    bool negative = false;
+    if(s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    u64 mantissa = 0;
+    i32 digits = 0;
+    i32 exponent = 0;
+    bool any = false;
+
+    // Past 19 significant digits the rest only moves the exponent
+    for(; s < end && Mesh_isDigit(*s); s++, any = true)
+    {
+        if(digits < 19)
+        {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    if(s < end && *s == '.')
+    {
+        for(s++; s < end && Mesh_isDigit(*s); s++, any = true)
+        {
+            if(digits < 19)
+            {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+
+    if(!any)
+        return nullptr;
+
+    if(s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char *e = s + 1;
+        bool negativeExponent = false;
+        if(e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+
+        if(e < end && Mesh_isDigit(*e))
+        {
+            i32 power = 0;
+            for(; e < end && Mesh_isDigit(*e); e++)
+            {
+                if(power < 100000)
+                    power = power * 10 + (*e - '0');
+            }
+
+            exponent += negativeExponent ? -power : power;
+            s = e;
+        }
+    }
+
+    double result = (double) mantissa;
+
+    if(exponent >= 0 && exponent <= 22)
+        result *= powers[exponent];
+    else if(exponent < 0 && exponent >= -22)
+        result /= powers[-exponent];
+    else
+        result *= pow(10.0, exponent);
+
+    value = (float)(negative ? -result : result);
+    return s;
+}
+
+static const char *Mesh_parseIndex(const char *s, const char *end, i64 &value)
+{
+    bool negative = false;
+    if(s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    if(s >= end || !Mesh_isDigit(*s))
+        return nullptr;
+
+    i64 result = 0;
+    for(; s < end && Mesh_isDigit(*s); s++)
+    {
+        if(result < ((i64) 1 << 40))
+            result = result * 10 + (*s - '0');
+    }
+
+    value = negative ? -result : result;
+    return s;
+}
+
+// 1-based index, or negative relative to the count so far, to 0-based.
+// MESH_NONE when it's out of range.
+static inline u32 Mesh_resolve(i64 index, u64 countSoFar, u64 total)
+{
+    i64 resolved = index > 0 ? index - 1 : (i64) countSoFar + index;
+    return resolved >= 0 && (u64) resolved < total ? (u32) resolved : MESH_NONE;
+}
+
+static void Mesh_countChunk(void *context, u32 index, u32 worker)
+{
+    (void) worker;
+
+    ObjChunk &chunk = ((ObjParse*) context)->chunks[index];
+
+    for(const char *line = chunk.begin; line < chunk.end; line = Mesh_nextLine(line, chunk.end))
+    {
+        const char *s = line;
+
+        switch(Mesh_statement(s, chunk.end))
+        {
+            case OBJ_POSITION: chunk.positions++; break;
+            case OBJ_UV:       chunk.uvs++;       break;
+            case OBJ_NORMAL:   chunk.normals++;   break;
+
+            case OBJ_FACE:
+            {
+                // Corners are the space-separated tokens, a fan has two fewer triangles
+                u64 corners = 0;
+                while(true)
+                {
+                    s = Mesh_skipSpaces(s, chunk.end);
+                    if(Mesh_isEnd(s, chunk.end))
+                        break;
+
+                    corners++;
+                    while(!Mesh_isEnd(s, chunk.end) && !Mesh_isSpace(*s))
+                        s++;
+                }
+
+                if(corners >= 3)
+                    chunk.triangles += corners - 2;
+            } break;
+
+            default: break;
+        }
+    }
+}
+
+static void Mesh_parseChunk(void *context, u32 index, u32 worker)
+{
+    (void) worker;
+
+    ObjParse &parse = *(ObjParse*) context;
+    ObjChunk &chunk = parse.chunks[index];
+
+    u64 position = chunk.positionBase;
+    u64 uv = chunk.uvBase;
+    u64 normal = chunk.normalBase;
+    u64 corner = chunk.triangleBase * 3;
+
+    for(const char *line = chunk.begin; line < chunk.end; line = Mesh_nextLine(line, chunk.end))
+    {
+        const char *s = line;
+        OBJ_STATEMENT statement = Mesh_statement(s, chunk.end);
+
+        if(statement == OBJ_POSITION)
+        {
+            float v[3] = {};
+            for(u32 i = 0; i < 3 && s; i++)
+                s = Mesh_parseFloat(s, chunk.end, v[i]);
+
+            parse.x[position] = v[0];
+            parse.y[position] = v[1];
+            parse.z[position] = v[2];
+            position++;
+        }
+        else if(statement == OBJ_UV)
+        {
+            float v[2] = {};
+            for(u32 i = 0; i < 2 && s; i++)
+                s = Mesh_parseFloat(s, chunk.end, v[i]);
+
+            parse.uvs[uv * 2 + 0] = v[0];
+            parse.uvs[uv * 2 + 1] = v[1];
+            uv++;
+        }
+        else if(statement == OBJ_NORMAL)
+        {
+            float v[3] = {};
+            for(u32 i = 0; i < 3 && s; i++)
+                s = Mesh_parseFloat(s, chunk.end, v[i]);
+
+            for(u32 i = 0; i < 3; i++)
+                parse.normals[normal * 3 + i] = v[i];
+            normal++;
+        }
+        else if(statement == OBJ_FACE)
+        {
+            // Corner k >= 2 closes the triangle (0, k - 1, k)
+            u32 first[3], previous[3];
+            u32 corners = 0;
+
+            while(true)
+            {
+                s = Mesh_skipSpaces(s, chunk.end);
+                if(Mesh_isEnd(s, chunk.end))
+                    break;
+
+                // p, p/t, p//n or p/t/n
+                i64 p = 0, t = 0, n = 0;
+                const char *next = Mesh_parseIndex(s, chunk.end, p);
+                if(next && next < chunk.end && *next == '/')
+                {
+                    next++;
+                    if(next < chunk.end && *next != '/')
+                        next = Mesh_parseIndex(next, chunk.end, t);
+
+                    if(next && next < chunk.end && *next == '/')
+                        next = Mesh_parseIndex(next + 1, chunk.end, n);
+                }
+
+                // Stay in step with the counting pass, which saw one token
+                while(!Mesh_isEnd(s, chunk.end) && !Mesh_isSpace(*s))
+                    s++;
+
+                u32 current[3];
+                current[0] = next && p ? Mesh_resolve(p, position, parse.positionCount) : MESH_NONE;
+                current[1] = t ? Mesh_resolve(t, uv, parse.uvCount) : MESH_NONE;
+                current[2] = n ? Mesh_resolve(n, normal, parse.normalCount) : MESH_NONE;
+
+                if(!next || current[0] == MESH_NONE || (t && current[1] == MESH_NONE) || (n && current[2] == MESH_NONE))
+                    chunk.invalid = true;
+
+                if(corners >= 2)
+                {
+                    const u32 *triangle[3] = {first, previous, current};
+
+                    for(u32 k = 0; k < 3; k++, corner++)
+                    {
+                        parse.cornerPositions[corner] = triangle[k][0];
+                        if(parse.cornerUVs)     parse.cornerUVs[corner] = triangle[k][1];
+                        if(parse.cornerNormals) parse.cornerNormals[corner] = triangle[k][2];
+                    }
+                }
+
+                if(corners == 0)
+                    memcpy(first, current, sizeof(first));
+
+                memcpy(previous, current, sizeof(previous));
+                corners++;
+            }
+        }
+    }
+}
+
+// Unique (position, uv, normal) corners become vertices. Buckets are
+// keyed by position index, each holds the few vertices sharing that
+// position, so lookups are a short chain walk instead of hashing tuples.
+static bool Mesh_buildVertices(ObjParse &parse, u64 cornerCount, Mesh &mesh)
+{
+    TRACE_FUNCTION();
+
+    // Every corner may be a new vertex. One spare entry keeps empty meshes allocatable.
+    u32 *heads = (u32*) Vertex_alignedAlloc((parse.positionCount + 1) * sizeof(u32));
+    u32 *next = (u32*) Vertex_alignedAlloc((cornerCount + 1) * sizeof(u32));
+    u32 *vertexPositions = (u32*) Vertex_alignedAlloc((cornerCount + 1) * sizeof(u32));
+    u32 *vertexUVs = (u32*) Vertex_alignedAlloc((cornerCount + 1) * sizeof(u32));
+    u32 *vertexNormals = (u32*) Vertex_alignedAlloc((cornerCount + 1) * sizeof(u32));
+    bool built = heads && next && vertexPositions && vertexUVs && vertexNormals;
+
+    if(built)
+    {
+        memset(heads, 0xFF, parse.positionCount * sizeof(u32));
+        u32 count = 0;
+
+        for(u64 c = 0; c < cornerCount; c++)
+        {
+            u32 p = parse.cornerPositions[c];
+            u32 t = parse.cornerUVs ? parse.cornerUVs[c] : MESH_NONE;
+            u32 n = parse.cornerNormals ? parse.cornerNormals[c] : MESH_NONE;
+
+            u32 v = heads[p];
+            while(v != MESH_NONE && (vertexUVs[v] != t || vertexNormals[v] != n))
+                v = next[v];
+
+            if(v == MESH_NONE)
+            {
+                v = count++;
+                vertexPositions[v] = p;
+                vertexUVs[v] = t;
+                vertexNormals[v] = n;
+                next[v] = heads[p];
+                heads[p] = v;
+            }
+
+            // Corner positions become the index buffer in place
+            parse.cornerPositions[c] = v;
+        }
+
+        mesh.vertexCount = count;
+        mesh.positions = Vertex_createStream(count + 1);
+        mesh.positions.count = count;
+        mesh.normals = parse.normalCount ? (float*) Vertex_alignedAlloc(((size_t) count + 1) * 3 * sizeof(float)) : nullptr;
+        mesh.uvs = parse.uvCount ? (float*) Vertex_alignedAlloc(((size_t) count + 1) * 2 * sizeof(float)) : nullptr;
+
+        built = mesh.positions.x && mesh.positions.y && mesh.positions.z &&
+                (mesh.normals || !parse.normalCount) && (mesh.uvs || !parse.uvCount);
+    }
+
+    if(built)
+    {
+        for(u32 v = 0; v < mesh.vertexCount; v++)
+        {
+            u32 p = vertexPositions[v];
+            mesh.positions.x[v] = parse.x[p];
+            mesh.positions.y[v] = parse.y[p];
+            mesh.positions.z[v] = parse.z[p];
+
+            if(mesh.normals)
+            {
+                u32 n = vertexNormals[v];
+                for(u32 i = 0; i < 3; i++)
+                    mesh.normals[v * 3 + i] = n != MESH_NONE ? parse.normals[n * 3 + i] : 0.0f;
+            }
+
+            if(mesh.uvs)
+            {
+                u32 t = vertexUVs[v];
+                for(u32 i = 0; i < 2; i++)
+                    mesh.uvs[v * 2 + i] = t != MESH_NONE ? parse.uvs[t * 2 + i] : 0.0f;
+            }
+        }
+    }
+
+    Vertex_alignedFree(heads);
+    Vertex_alignedFree(next);
+    Vertex_alignedFree(vertexPositions);
+    Vertex_alignedFree(vertexUVs);
+    Vertex_alignedFree(vertexNormals);
+    return built;
+}
+
+bool Mesh_loadOBJ(const char *path, Mesh &mesh)
+{
+    TRACE_FUNCTION();
+
+    mesh = {};
+
+    size_t size;
+    const char *text = (const char*) Cache_mapFile(path, false, size);
+
+    if(!text)
+    {
+        fprintf(stderr, "Error: Failed to open mesh: %s\n", path);
+        return false;
+    }
+
+    // Chunks start after the newline at or past their even split point
+    u32 chunkCount = (u32)(size / MESH_CHUNK_SIZE) + 1;
+    const char *end = text + size;
+    ObjChunk *chunks = new ObjChunk[chunkCount]();
+
+    for(u32 i = 0; i < chunkCount; i++)
+    {
+        const char *split = text + (size_t)((u64) size * i / chunkCount);
+        chunks[i].begin = i == 0 ? text : Mesh_nextLine(split - 1, end);
+    }
+
+    for(u32 i = 0; i < chunkCount; i++)
+        chunks[i].end = i + 1 < chunkCount ? chunks[i + 1].begin : end;
+
+    ObjParse parse = {};
+    parse.chunks = chunks;
+    Jobs_parallelFor(chunkCount, Mesh_countChunk, &parse);
+
+    u64 triangleCount = 0;
+    for(u32 i = 0; i < chunkCount; i++)
+    {
+        chunks[i].positionBase = parse.positionCount;
+        chunks[i].uvBase = parse.uvCount;
+        chunks[i].normalBase = parse.normalCount;
+        chunks[i].triangleBase = triangleCount;
+
+        parse.positionCount += chunks[i].positions;
+        parse.uvCount += chunks[i].uvs;
+        parse.normalCount += chunks[i].normals;
+        triangleCount += chunks[i].triangles;
+    }
+
+    bool loaded = false;
+    u64 cornerCount = triangleCount * 3;
+
+    if(parse.positionCount >= MESH_NONE || cornerCount >= MESH_NONE)
+    {
+        fprintf(stderr, "Error: Mesh too large: %s\n", path);
+    }
+    else
+    {
+        // Positions in a stream too: without uvs or normals they are the vertices.
+        // Spare entries keep empty arrays allocatable, like the dedup tables.
+        VertexStream positions = Vertex_createStream((u32) parse.positionCount + 1);
+        parse.x = positions.x;
+        parse.y = positions.y;
+        parse.z = positions.z;
+        parse.uvs = (float*) Vertex_alignedAlloc((parse.uvCount + 1) * 2 * sizeof(float));
+        parse.normals = (float*) Vertex_alignedAlloc((parse.normalCount + 1) * 3 * sizeof(float));
+        parse.cornerPositions = (u32*) Vertex_alignedAlloc((cornerCount + 1) * sizeof(u32));
+        parse.cornerUVs = parse.uvCount ? (u32*) Vertex_alignedAlloc((cornerCount + 1) * sizeof(u32)) : nullptr;
+        parse.cornerNormals = parse.normalCount ? (u32*) Vertex_alignedAlloc((cornerCount + 1) * sizeof(u32)) : nullptr;
+
+        bool allocated = parse.x && parse.y && parse.z && parse.uvs && parse.normals && parse.cornerPositions &&
+                         (parse.cornerUVs || !parse.uvCount) && (parse.cornerNormals || !parse.normalCount);
+
+        bool invalid = false;
+        if(allocated)
+        {
+            Jobs_parallelFor(chunkCount, Mesh_parseChunk, &parse);
+
+            for(u32 i = 0; i < chunkCount; i++)
+                invalid |= chunks[i].invalid;
+        }
+
+        if(!allocated)
+        {
+            fprintf(stderr, "Error: Failed to allocate mesh: %s\n", path);
+        }
+        else if(invalid)
+        {
+            fprintf(stderr, "Error: Mesh face refers to a missing vertex: %s\n", path);
+        }
+        else if(!parse.cornerUVs && !parse.cornerNormals)
+        {
+            mesh.positions = positions;
+            mesh.positions.count = (u32) parse.positionCount;
+            mesh.vertexCount = (u32) parse.positionCount;
+            positions = {};
+            loaded = true;
+        }
+        else
+        {
+            loaded = Mesh_buildVertices(parse, cornerCount, mesh);
+            if(!loaded)
+                fprintf(stderr, "Error: Failed to allocate mesh vertices: %s\n", path);
+        }
+
+        if(loaded)
+        {
+            mesh.indices = parse.cornerPositions;
+            mesh.triangleCount = (u32) triangleCount;
+            parse.cornerPositions = nullptr;
+            Mesh_computeBounds(mesh);
+        }
+
+        Vertex_destroyStream(positions);
+        Vertex_alignedFree(parse.uvs);
+        Vertex_alignedFree(parse.normals);
+        Vertex_alignedFree(parse.cornerPositions);
+        Vertex_alignedFree(parse.cornerUVs);
+        Vertex_alignedFree(parse.cornerNormals);
+    }
+
+    delete[] chunks;
+    Cache_unmapFile(text, size);
+
+    if(!loaded)
+        Mesh_free(mesh);
+
+    return loaded;
+}
+
+void Mesh_free(Mesh &mesh)
+{
+    if(mesh.storage == MESH_MAPPED)
+    {
+        Cache_unmapFile(mesh.mapping, mesh.mappingSize);
+    }
+    else
+    {
+        Vertex_destroyStream(mesh.positions);
+        Vertex_alignedFree(mesh.normals);
+        Vertex_alignedFree(mesh.uvs);
+        Vertex_alignedFree(mesh.indices);
+    }
+
+    mesh = {};
+}
+
+void Mesh_computeBounds(Mesh &mesh)
+{
+    const VertexStream &p = mesh.positions;
+
+    if(mesh.vertexCount == 0)
+    {
+        mesh.boundsMin = mesh.boundsMax = mesh.center = {0, 0, 0};
+        mesh.radius = 0;
+        return;
+    }
+
+    Vector3 lo = {p.x[0], p.y[0], p.z[0]};
+    Vector3 hi = lo;
+
+    for(u32 i = 1; i < mesh.vertexCount; i++)
+    {
+        lo.x = fminf(lo.x, p.x[i]); hi.x = fmaxf(hi.x, p.x[i]);
+        lo.y = fminf(lo.y, p.y[i]); hi.y = fmaxf(hi.y, p.y[i]);
+        lo.z = fminf(lo.z, p.z[i]); hi.z = fmaxf(hi.z, p.z[i]);
+    }
+
+    Vector3 c = {(lo.x + hi.x) * 0.5f, (lo.y + hi.y) * 0.5f, (lo.z + hi.z) * 0.5f};
+    float radiusSquared = 0;
+
+    for(u32 i = 0; i < mesh.vertexCount; i++)
+    {
+        float dx = p.x[i] - c.x, dy = p.y[i] - c.y, dz = p.z[i] - c.z;
+        radiusSquared = fmaxf(radiusSquared, dx * dx + dy * dy + dz * dz);
+    }
+
+    mesh.boundsMin = lo;
+    mesh.boundsMax = hi;
+    mesh.center = c;
+    mesh.radius = sqrtf(radiusSquared);
+}
+
+static void Mesh_cachePath(const char *path, char *result, size_t capacity)
+{
+    Cache_blobPath(meshCacheDirectory, path, ".mesh", result, capacity);
+}
+
+static u64 Mesh_align(u64 offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(u64)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Array offsets and blob size for the header's counts, flags and path
+static void Mesh_cacheLayout(MeshCacheHeader &header)
+{
+    u64 floats = (u64) header.vertexCount * sizeof(float);
+    u64 offset = Mesh_align(sizeof(MeshCacheHeader) + header.pathLength);
+
+    header.xOffset = offset;        offset = Mesh_align(offset + floats);
+    header.yOffset = offset;        offset = Mesh_align(offset + floats);
+    header.zOffset = offset;        offset = Mesh_align(offset + floats);
+    header.normalOffset = 0;
+    header.uvOffset = 0;
+
+    if(header.flags & MESH_CACHE_NORMALS)
+    {
+        header.normalOffset = offset;
+        offset = Mesh_align(offset + floats * 3);
+    }
+
+    if(header.flags & MESH_CACHE_UVS)
+    {
+        header.uvOffset = offset;
+        offset = Mesh_align(offset + floats * 2);
+    }
+
+    header.indexOffset = offset;
+    header.size = offset + (u64) header.triangleCount * 3 * sizeof(u32);
+}
+
+static bool Mesh_validBlob(const u8 *blob, size_t size, const char *path, CacheSource source)
+{
+    if(size < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, blob, sizeof(header));
+
+    size_t pathLength = strlen(path);
+
+    if(header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION)
+        return false;
+
+    if(header.sourceSize != source.size || header.sourceTime != source.time)
+        return false;
+
+    if(header.pathLength != pathLength || (header.flags & ~(MESH_CACHE_NORMALS | MESH_CACHE_UVS)))
+        return false;
+
+    // Offsets have to be the ones this version writes, which also keeps
+    // every array aligned and inside the blob
+    MeshCacheHeader expected = header;
+    Mesh_cacheLayout(expected);
+
+    if(memcmp(&header, &expected, sizeof(header)) != 0 || header.size > size)
+        return false;
+
+    if(memcmp(blob + sizeof(header), path, pathLength) != 0)
+        return false;
+
+    // Indices go straight to the draw, so every one has to name a vertex
+    const u32 *indices = (const u32*)(blob + header.indexOffset);
+    for(u64 i = 0; i < (u64) header.triangleCount * 3; i++)
+    {
+        if(indices[i] >= header.vertexCount)
+            return false;
+    }
+
+    return true;
+}
+
+static bool Mesh_loadCache(const char *path, CacheSource source, Mesh &mesh)
+{
+    char filename[CACHE_PATH_SIZE];
+    Mesh_cachePath(path, filename, sizeof(filename));
+
+    size_t size;
+    u8 *blob = (u8*) Cache_mapFile(filename, true, size);
+
+    if(!blob)
+        return false;
+
+    if(!Mesh_validBlob(blob, size, path, source))
+    {
+        Cache_unmapFile(blob, size);
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, blob, sizeof(header));
+
+    // Pointer fixups are the whole load
+    mesh.positions.x = (float*)(blob + header.xOffset);
+    mesh.positions.y = (float*)(blob + header.yOffset);
+    mesh.positions.z = (float*)(blob + header.zOffset);
+    mesh.positions.count = header.vertexCount;
+    mesh.positions.capacity = header.vertexCount;
+    mesh.normals = header.normalOffset ? (float*)(blob + header.normalOffset) : nullptr;
+    mesh.uvs = header.uvOffset ? (float*)(blob + header.uvOffset) : nullptr;
+    mesh.vertexCount = header.vertexCount;
+    mesh.indices = (u32*)(blob + header.indexOffset);
+    mesh.triangleCount = header.triangleCount;
+
+    mesh.boundsMin = {header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]};
+    mesh.boundsMax = {header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]};
+    mesh.center = {header.center[0], header.center[1], header.center[2]};
+    mesh.radius = header.radius;
+
+    mesh.storage = MESH_MAPPED;
+    mesh.mapping = blob;
+    mesh.mappingSize = size;
+    return true;
+}
+
+bool Mesh_storeCache(const char *path, CacheSource source, const Mesh &mesh)
+{
+    TRACE_FUNCTION();
+
+    char filename[CACHE_PATH_SIZE];
+    Mesh_cachePath(path, filename, sizeof(filename));
+
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceSize = source.size;
+    header.sourceTime = source.time;
+    header.vertexCount = mesh.vertexCount;
+    header.triangleCount = mesh.triangleCount;
+    header.flags = (mesh.normals ? MESH_CACHE_NORMALS : 0) | (mesh.uvs ? MESH_CACHE_UVS : 0);
+    header.pathLength = (u32) strlen(path);
+
+    header.boundsMin[0] = mesh.boundsMin.x; header.boundsMin[1] = mesh.boundsMin.y; header.boundsMin[2] = mesh.boundsMin.z;
+    header.boundsMax[0] = mesh.boundsMax.x; header.boundsMax[1] = mesh.boundsMax.y; header.boundsMax[2] = mesh.boundsMax.z;
+    header.center[0] = mesh.center.x;       header.center[1] = mesh.center.y;       header.center[2] = mesh.center.z;
+    header.radius = mesh.radius;
+
+    Mesh_cacheLayout(header);
+
+    CacheWriter writer;
+    if(!Cache_beginWrite(writer, meshCacheDirectory, filename))
+        return false;
+
+    size_t floats = (size_t) mesh.vertexCount * sizeof(float);
+
+    bool written = Cache_write(writer, 0, &header, sizeof(header)) &&
+                   Cache_write(writer, sizeof(header), path, header.pathLength) &&
+                   Cache_write(writer, header.xOffset, mesh.positions.x, floats) &&
+                   Cache_write(writer, header.yOffset, mesh.positions.y, floats) &&
+                   Cache_write(writer, header.zOffset, mesh.positions.z, floats) &&
+                   (!mesh.normals || Cache_write(writer, header.normalOffset, mesh.normals, floats * 3)) &&
+                   (!mesh.uvs || Cache_write(writer, header.uvOffset, mesh.uvs, floats * 2)) &&
+                   Cache_write(writer, header.indexOffset, mesh.indices, (size_t) mesh.triangleCount * 3 * sizeof(u32));
+
+    return Cache_endWrite(writer, written);
+}
+
+bool Mesh_load(const char *path, Mesh &mesh)
+{
+    TRACE_FUNCTION();
+
+    mesh = {};
+
+    CacheSource source;
+    if(!Cache_statSource(path, source))
+        return false;
+
+    if(Mesh_loadCache(path, source, mesh))
+        return true;
+
+    if(!Mesh_loadOBJ(path, mesh))
+        return false;
+
+    if(!Mesh_storeCache(path, source, mesh))
+        fprintf(stderr, "Warning: Failed to write mesh cache for %s\n", path);
+
+    return true;
+}
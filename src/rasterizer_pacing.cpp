@@ -0,0 +1,125 @@
+#include "rasterizer_pacing.h"
+#include "rasterizer_trace.h"
+
+#include <math.h>
+#include <chrono>
+#include <thread>
+
+const u64 PACING_SLEEP_NS = 1000000;
+
+u64 Pacing_nowNs()
+{
+    using namespace std::chrono;
+    return (u64) duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Welford update of a running mean and sum of squared deviations
+static void Pacing_accumulate(double value, u32 &count, double &mean, double &m2)
+{
+    count++;
+    double delta = value - mean;
+    mean += delta / count;
+    m2 += delta * (value - mean);
+}
+
+void Pacing_initialize(FramePacer &pacer, double frameRate, double simulationRate)
+{
+    pacer = {};
+    pacer.periodNs = frameRate > 0 ? (u64)(1e9 / frameRate) : 0;
+    pacer.stepNs = (u64)(1e9 / simulationRate);
+
+    // Assume a 1 ms timer until sleeps have been measured
+    pacer.sleepMean = 1e6;
+}
+
+u32 Pacing_beginFrame(FramePacer &pacer)
+{
+    u64 now = Pacing_nowNs();
+
+    if(pacer.frameStart)
+    {
+        double interval = (double)(now - pacer.frameStart);
+        Pacing_accumulate(interval, pacer.intervals, pacer.intervalMean, pacer.intervalM2);
+        if(interval > pacer.intervalMax) pacer.intervalMax = interval;
+
+        pacer.accumulator += now - pacer.frameStart;
+    }
+    else
+    {
+        // First frame runs one step
+        pacer.accumulator = pacer.stepNs;
+        pacer.deadline = now;
+    }
+
+    pacer.frameStart = now;
+    pacer.deadline += pacer.periodNs;
+
+    u32 steps = (u32)(pacer.accumulator / pacer.stepNs);
+    if(steps > PACING_MAX_STEPS)
+    {
+        steps = PACING_MAX_STEPS;
+        pacer.accumulator = 0;
+    }
+    else
+    {
+        pacer.accumulator -= (u64) steps * pacer.stepNs;
+    }
+
+    return steps;
+}
+
+void Pacing_endFrame(FramePacer &pacer)
+{
+    TRACE_FUNCTION();
+
+    if(!pacer.periodNs)
+        return;
+
+    u64 now = Pacing_nowNs();
+
+    // A missed deadline restarts the schedule from now instead of running
+    // the following frames back to back to catch up
+    if(now >= pacer.deadline)
+    {
+        pacer.missed++;
+        pacer.deadline = now;
+        return;
+    }
+
+    while(true)
+    {
+        // Sleep while a slice can't run past the deadline, judged by the
+        // measured mean sleep plus one standard deviation
+        double margin = pacer.sleepMean + (pacer.sleeps > 1 ? sqrt(pacer.sleepM2 / (pacer.sleeps - 1)) : 0);
+        if((double)(pacer.deadline - now) <= margin)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::nanoseconds(PACING_SLEEP_NS));
+
+        u64 woke = Pacing_nowNs();
+        Pacing_accumulate((double)(woke - now), pacer.sleeps, pacer.sleepMean, pacer.sleepM2);
+        now = woke;
+
+        if(now >= pacer.deadline)
+            return;
+    }
+
+    while(Pacing_nowNs() < pacer.deadline)
+        std::this_thread::yield();
+}
+
+double Pacing_stepSeconds(const FramePacer &pacer)
+{
+    return pacer.stepNs / 1e9;
+}
+
+FrameStats Pacing_stats(const FramePacer &pacer)
+{
+    FrameStats stats;
+    stats.frames = pacer.intervals;
+    stats.missed = pacer.missed;
+    stats.meanMs = pacer.intervalMean / 1e6;
+    stats.jitterMs = pacer.intervals > 1 ? sqrt(pacer.intervalM2 / (pacer.intervals - 1)) / 1e6 : 0;
+    stats.maxMs = pacer.intervalMax / 1e6;
+    return stats;
+}
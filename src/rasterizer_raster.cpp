@@ -0,0 +1,970 @@
+#include "rasterizer_raster.h"
+#include "rasterizer_simd.h"
+#include "rasterizer_span.h"
+#include "rasterizer_clip.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Block base values are clamped to this before adding the per-lane
+// offsets. Any clamped value is far enough from zero that the lane
+// offsets (bounded by the guard band) cannot change its sign.
+const i64 RASTER_LANE_CLAMP = 1 << 30;
+
+// Depth plane bounds are evaluated at block corners; this margin keeps
+// float rounding of interior pixels from defeating the conservative test
+const float RASTER_DEPTH_MARGIN = 1e-5f;
+
+static i32 Raster_clampLane(i64 e)
+{
+    if(e > RASTER_LANE_CLAMP) return (i32) RASTER_LANE_CLAMP;
+    if(e < -RASTER_LANE_CLAMP) return (i32) -RASTER_LANE_CLAMP;
+    return (i32) e;
+}
+
+RasterRect Raster_intersectRect(RasterRect a, RasterRect b)
+{
+    RasterRect result;
+    result.minX = a.minX > b.minX ? a.minX : b.minX;
+    result.minY = a.minY > b.minY ? a.minY : b.minY;
+    result.maxX = a.maxX < b.maxX ? a.maxX : b.maxX;
+    result.maxY = a.maxY < b.maxY ? a.maxY : b.maxY;
+    return result;
+}
+
+static i32 Raster_snap(float v)
+{
+    return (i32) floorf(v * RASTER_SUBPIXEL_ONE + 0.5f);
+}
+
+static bool Raster_setupEdges(TriangleSetup &setup, Vector3 vertices[3], RasterCull cull)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        // Also rejects NaN coordinates
+        if(!(fabsf(vertices[i].x) <= RASTER_GUARD_BAND && fabsf(vertices[i].y) <= RASTER_GUARD_BAND))
+            return false;
+    }
+
+    i64 x[3], y[3];
+    for(int i = 0; i < 3; i++)
+    {
+        x[i] = Raster_snap(vertices[i].x);
+        y[i] = Raster_snap(vertices[i].y);
+    }
+
+    // Twice the signed area, made positive so inside means E >= 0
+    i64 area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+
+    if(area == 0)
+    {
+        clipStats.trianglesDegenerate++;
+        return false;
+    }
+
+    // Positive area winds clockwise on screen
+    if(cull.mode != CULL_NONE)
+    {
+        bool front = (area > 0) == (cull.frontFace == WINDING_CLOCKWISE);
+        if(front == (cull.mode == CULL_FRONT))
+        {
+            clipStats.trianglesBackfacing++;
+            return false;
+        }
+    }
+
+    if(area < 0)
+    {
+        i64 t;
+        t = x[1]; x[1] = x[2]; x[2] = t;
+        t = y[1]; y[1] = y[2]; y[2] = t;
+
+        Vector3 v = vertices[1]; vertices[1] = vertices[2]; vertices[2] = v;
+        area = -area;
+    }
+
+    const i64 half = RASTER_SUBPIXEL_ONE / 2;
+
+    // Edge i is opposite vertex i
+    for(int i = 0; i < 3; i++)
+    {
+        int from = (i + 1) % 3;
+        int to = (i + 2) % 3;
+
+        i64 a = y[from] - y[to];
+        i64 b = x[to] - x[from];
+
+        // Top-left rule: pixels exactly on a right or bottom edge belong
+        // to the neighbouring triangle
+        bool topLeft = a > 0 || (a == 0 && b > 0);
+
+        setup.stepX[i] = a * RASTER_SUBPIXEL_ONE;
+        setup.stepY[i] = b * RASTER_SUBPIXEL_ONE;
+        setup.origin[i] = a * (half - x[from]) + b * (half - y[from]) + (topLeft ? 0 : -1);
+    }
+
+    i64 minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+    for(int i = 1; i < 3; i++)
+    {
+        if(x[i] < minX) minX = x[i];
+        if(x[i] > maxX) maxX = x[i];
+        if(y[i] < minY) minY = y[i];
+        if(y[i] > maxY) maxY = y[i];
+    }
+
+    setup.bounds.minX = (i32)((minX - half) >> RASTER_SUBPIXEL_BITS);
+    setup.bounds.minY = (i32)((minY - half) >> RASTER_SUBPIXEL_BITS);
+    setup.bounds.maxX = (i32)((maxX - half) >> RASTER_SUBPIXEL_BITS) + 1;
+    setup.bounds.maxY = (i32)((maxY - half) >> RASTER_SUBPIXEL_BITS) + 1;
+
+    // Bounds one pixel wide with no centre on or inside them on that axis:
+    // sliver or sub-pixel triangle that covers no sample
+    bool emptyX = setup.bounds.maxX - setup.bounds.minX == 1 && ((minX - half) & (RASTER_SUBPIXEL_ONE - 1)) != 0;
+    bool emptyY = setup.bounds.maxY - setup.bounds.minY == 1 && ((minY - half) & (RASTER_SUBPIXEL_ONE - 1)) != 0;
+
+    if(emptyX || emptyY)
+    {
+        clipStats.trianglesEmpty++;
+        return false;
+    }
+
+    // Depth plane through the snapped vertices, sampled at pixel centres
+    double px[3], py[3];
+    for(int i = 0; i < 3; i++)
+    {
+        px[i] = (double) x[i] / RASTER_SUBPIXEL_ONE;
+        py[i] = (double) y[i] / RASTER_SUBPIXEL_ONE;
+    }
+
+    double doubleArea = (double) area / (RASTER_SUBPIXEL_ONE * RASTER_SUBPIXEL_ONE);
+    double dz1 = vertices[1].z - vertices[0].z;
+    double dz2 = vertices[2].z - vertices[0].z;
+    double dzdx = (dz1 * (py[2] - py[0]) - dz2 * (py[1] - py[0])) / doubleArea;
+    double dzdy = (dz2 * (px[1] - px[0]) - dz1 * (px[2] - px[0])) / doubleArea;
+
+    setup.zStepX = (float) dzdx;
+    setup.zStepY = (float) dzdy;
+    setup.zOrigin = (float)(vertices[0].z + dzdx * (0.5 - px[0]) + dzdy * (0.5 - py[0]));
+
+    setup.zMin = fminf(vertices[0].z, fminf(vertices[1].z, vertices[2].z));
+    setup.zMax = fmaxf(vertices[0].z, fmaxf(vertices[1].z, vertices[2].z));
+
+    return true;
+}
+
+bool Raster_setupTriangle(TriangleSetup &setup, Vector2 v0, Vector2 v1, Vector2 v2, RasterCull cull)
+{
+    Vector3 vertices[3] = {{v0.x, v0.y, 0}, {v1.x, v1.y, 0}, {v2.x, v2.y, 0}};
+
+    setup.depthTest = false;
+    return Raster_setupEdges(setup, vertices, cull);
+}
+
+bool Raster_setupTriangleDepth(TriangleSetup &setup, Vector3 v0, Vector3 v1, Vector3 v2, RasterCull cull)
+{
+    Vector3 vertices[3] = {v0, v1, v2};
+
+    setup.depthTest = true;
+    return Raster_setupEdges(setup, vertices, cull);
+}
+
+// Axis-aligned rectangle at constant depth, its edges always pass so the
+// triangle traversal reduces to the depth test and the bounds
+void Raster_setupRectangle(TriangleSetup &setup, RasterRect rect, float depth)
+{
+    for(int i = 0; i < 3; i++)
+    {
+        setup.origin[i] = RASTER_LANE_CLAMP;
+        setup.stepX[i] = 0;
+        setup.stepY[i] = 0;
+    }
+
+    setup.depthTest = true;
+    setup.zOrigin = depth;
+    setup.zStepX = 0;
+    setup.zStepY = 0;
+    setup.zMin = depth;
+    setup.zMax = depth;
+    setup.bounds = rect;
+}
+
+// Per-block work shared by every kernel. Blocks are aligned to absolute
+// DEPTH_BLOCK_SIZE multiples, so a pixel is always handled by the same
+// kernel whatever the clip rect, and tiled output matches one pass.
+struct RasterBlock
+{
+    RasterRect rect;        // Pixels to consider, inside the block
+    i32 x;                  // Block origin
+    i32 y;
+    float zRow[DEPTH_BLOCK_SIZE];
+    bool depthTest;
+    bool depthAlwaysPasses; // Whole block is in front of the stored depth
+};
+
+typedef bool (*BlockKernel)(FrameBuffer &buffer, TriangleSetup &setup, RasterBlock &block, u32 color);
+
+// Exact per-pixel evaluation. Also handles blocks that cross the right
+// edge of the framebuffer, where a vector access would leave the row.
+static bool Raster_blockScalar(FrameBuffer &buffer, TriangleSetup &setup, RasterBlock &block, u32 color)
+{
+    bool written = false;
+    RasterRect r = block.rect;
+
+    for(i32 y = r.minY; y < r.maxY; y++)
+    {
+        u32 *row = buffer.buffer + (size_t) y * buffer.width;
+        float *depthRow = block.depthTest ? buffer.depth->depth + (size_t) y * buffer.width : nullptr;
+        float zRow = block.zRow[y - block.y];
+
+        i64 e0 = setup.origin[0] + setup.stepX[0] * r.minX + setup.stepY[0] * y;
+        i64 e1 = setup.origin[1] + setup.stepX[1] * r.minX + setup.stepY[1] * y;
+        i64 e2 = setup.origin[2] + setup.stepX[2] * r.minX + setup.stepY[2] * y;
+
+        for(i32 x = r.minX; x < r.maxX; x++)
+        {
+            if((e0 | e1 | e2) >= 0)
+            {
+                if(block.depthTest)
+                {
+                    float z = setup.zStepX * (float) x + zRow;
+
+                    if(block.depthAlwaysPasses || z < depthRow[x])
+                    {
+                        depthRow[x] = z;
+                        row[x] = color;
+                        written = true;
+                    }
+                }
+                else
+                {
+                    row[x] = color;
+                    written = true;
+                }
+            }
+
+            e0 += setup.stepX[0];
+            e1 += setup.stepX[1];
+            e2 += setup.stepX[2];
+        }
+    }
+
+    return written;
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET("sse2")
+static bool Raster_blockSSE2(FrameBuffer &buffer, TriangleSetup &setup, RasterBlock &block, u32 color)
+{
+    bool written = false;
+    RasterRect r = block.rect;
+
+    __m128i colorVec = _mm_set1_epi32((int) color);
+    __m128 zStepX = _mm_set1_ps(setup.zStepX);
+
+    // Two 4-wide halves per block row
+    for(i32 half = 0; half < 2; half++)
+    {
+        i32 x = block.x + half * 4;
+
+        if(x + 4 <= r.minX || x >= r.maxX)
+            continue;
+
+        __m128i xs = _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3));
+        __m128i inRange = _mm_and_si128(_mm_cmpgt_epi32(xs, _mm_set1_epi32(r.minX - 1)),
+                                        _mm_cmplt_epi32(xs, _mm_set1_epi32(r.maxX)));
+        __m128 xf = _mm_cvtepi32_ps(xs);
+
+        __m128i laneOffsets[3];
+        for(int i = 0; i < 3; i++)
+        {
+            i32 step = (i32) setup.stepX[i];
+            laneOffsets[i] = _mm_setr_epi32(0, step, step * 2, step * 3);
+        }
+
+        for(i32 y = r.minY; y < r.maxY; y++)
+        {
+            __m128i outside = _mm_setzero_si128();
+            for(int i = 0; i < 3; i++)
+            {
+                i64 e = setup.origin[i] + setup.stepX[i] * x + setup.stepY[i] * y;
+                outside = _mm_or_si128(outside, _mm_add_epi32(_mm_set1_epi32(Raster_clampLane(e)), laneOffsets[i]));
+            }
+
+            // All ones where the pixel is covered and inside the rect
+            __m128i covered = _mm_andnot_si128(_mm_srai_epi32(outside, 31), inRange);
+
+            __m128 *depthPtr = nullptr;
+            __m128 z = _mm_setzero_ps();
+
+            if(block.depthTest)
+            {
+                depthPtr = (__m128*)(buffer.depth->depth + (size_t) y * buffer.width + x);
+                z = _mm_add_ps(_mm_mul_ps(zStepX, xf), _mm_set1_ps(block.zRow[y - block.y]));
+
+                if(!block.depthAlwaysPasses)
+                    covered = _mm_and_si128(covered, _mm_castps_si128(_mm_cmplt_ps(z, _mm_loadu_ps((float*) depthPtr))));
+            }
+
+            if(_mm_movemask_ps(_mm_castsi128_ps(covered)) == 0)
+                continue;
+
+            // No masked store in SSE2, the block lies inside one tile and one row
+            __m128i *dst = (__m128i*)(buffer.buffer + (size_t) y * buffer.width + x);
+            __m128i old = _mm_loadu_si128(dst);
+            _mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(covered, colorVec), _mm_andnot_si128(covered, old)));
+
+            if(block.depthTest)
+            {
+                __m128 mask = _mm_castsi128_ps(covered);
+                __m128 oldZ = _mm_loadu_ps((float*) depthPtr);
+                _mm_storeu_ps((float*) depthPtr, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, oldZ)));
+            }
+
+            written = true;
+        }
+    }
+
+    return written;
+}
+
+SIMD_TARGET("avx2")
+static bool Raster_blockAVX2(FrameBuffer &buffer, TriangleSetup &setup, RasterBlock &block, u32 color)
+{
+    bool written = false;
+    RasterRect r = block.rect;
+
+    __m256i colorVec = _mm256_set1_epi32((int) color);
+    __m256i xs = _mm256_add_epi32(_mm256_set1_epi32(block.x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i inRange = _mm256_and_si256(_mm256_cmpgt_epi32(xs, _mm256_set1_epi32(r.minX - 1)),
+                                       _mm256_cmpgt_epi32(_mm256_set1_epi32(r.maxX), xs));
+    __m256 z = _mm256_mul_ps(_mm256_set1_ps(setup.zStepX), _mm256_cvtepi32_ps(xs));
+
+    __m256i laneOffsets[3];
+    for(int i = 0; i < 3; i++)
+    {
+        laneOffsets[i] = _mm256_mullo_epi32(_mm256_set1_epi32((i32) setup.stepX[i]),
+                                            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    }
+
+    for(i32 y = r.minY; y < r.maxY; y++)
+    {
+        __m256i outside = _mm256_setzero_si256();
+        for(int i = 0; i < 3; i++)
+        {
+            i64 e = setup.origin[i] + setup.stepX[i] * block.x + setup.stepY[i] * y;
+            outside = _mm256_or_si256(outside, _mm256_add_epi32(_mm256_set1_epi32(Raster_clampLane(e)), laneOffsets[i]));
+        }
+
+        __m256i covered = _mm256_andnot_si256(_mm256_srai_epi32(outside, 31), inRange);
+
+        float *depthRow = nullptr;
+        __m256 rowZ = _mm256_setzero_ps();
+
+        if(block.depthTest)
+        {
+            depthRow = buffer.depth->depth + (size_t) y * buffer.width + block.x;
+            rowZ = _mm256_add_ps(z, _mm256_set1_ps(block.zRow[y - block.y]));
+
+            if(!block.depthAlwaysPasses)
+            {
+                __m256 stored = _mm256_loadu_ps(depthRow);
+                covered = _mm256_and_si256(covered, _mm256_castps_si256(_mm256_cmp_ps(rowZ, stored, _CMP_LT_OQ)));
+            }
+        }
+
+        if(_mm256_testz_si256(covered, covered))
+            continue;
+
+        // Masked-off lanes are not written at all
+        _mm256_maskstore_epi32((int*)(buffer.buffer + (size_t) y * buffer.width + block.x), covered, colorVec);
+
+        if(block.depthTest)
+            _mm256_maskstore_ps(depthRow, covered, rowZ);
+
+        written = true;
+    }
+
+    return written;
+}
+
+#endif
+
+void Raster_updateDepthBlock(DepthBuffer &depth, FrameBuffer &buffer, u32 blockX, u32 blockY)
+{
+    u32 x0 = blockX * DEPTH_BLOCK_SIZE;
+    u32 y0 = blockY * DEPTH_BLOCK_SIZE;
+    u32 x1 = x0 + DEPTH_BLOCK_SIZE < buffer.width ? x0 + DEPTH_BLOCK_SIZE : buffer.width;
+    u32 y1 = y0 + DEPTH_BLOCK_SIZE < buffer.height ? y0 + DEPTH_BLOCK_SIZE : buffer.height;
+
+    float minZ = DEPTH_FAR;
+    float maxZ = -DEPTH_FAR;
+
+    for(u32 y = y0; y < y1; y++)
+    {
+        float *row = depth.depth + (size_t) y * buffer.width;
+
+        for(u32 x = x0; x < x1; x++)
+        {
+            minZ = row[x] < minZ ? row[x] : minZ;
+            maxZ = row[x] > maxZ ? row[x] : maxZ;
+        }
+    }
+
+    depth.blockMin[blockY * depth.blocksX + blockX] = minZ;
+    depth.blockMax[blockY * depth.blocksX + blockX] = maxZ;
+}
+
+void Raster_updateDepthTile(DepthBuffer &depth, u32 tileX, u32 tileY)
+{
+    const u32 BLOCKS_PER_TILE = DEPTH_TILE_SIZE / DEPTH_BLOCK_SIZE;
+
+    u32 bx0 = tileX * BLOCKS_PER_TILE;
+    u32 by0 = tileY * BLOCKS_PER_TILE;
+    u32 bx1 = bx0 + BLOCKS_PER_TILE < depth.blocksX ? bx0 + BLOCKS_PER_TILE : depth.blocksX;
+    u32 by1 = by0 + BLOCKS_PER_TILE < depth.blocksY ? by0 + BLOCKS_PER_TILE : depth.blocksY;
+
+    float maxZ = -DEPTH_FAR;
+
+    for(u32 by = by0; by < by1; by++)
+    {
+        for(u32 bx = bx0; bx < bx1; bx++)
+        {
+            float z = depth.blockMax[by * depth.blocksX + bx];
+            maxZ = z > maxZ ? z : maxZ;
+        }
+    }
+
+    depth.tileMax[tileY * depth.tilesX + tileX] = maxZ;
+}
+
+void Raster_clearDepth(FrameBuffer &buffer, RasterRect clip, float value)
+{
+    DepthBuffer *depth = buffer.depth;
+
+    if(!depth)
+        return;
+
+    RasterRect screen = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    RasterRect r = Raster_intersectRect(clip, screen);
+
+    if(r.minX >= r.maxX || r.minY >= r.maxY)
+        return;
+
+    if(r.minX == 0 && r.maxX == (i32) buffer.width)
+    {
+        // Whole rows are one contiguous run, written as raw bits
+        u32 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        Simd_clear((u32*)(depth->depth + (size_t) r.minY * buffer.width), (size_t)(r.maxY - r.minY) * buffer.width, bits);
+    }
+    else
+    {
+        for(i32 y = r.minY; y < r.maxY; y++)
+        {
+            float *row = depth->depth + (size_t) y * buffer.width;
+
+            for(i32 x = r.minX; x < r.maxX; x++)
+                row[x] = value;
+        }
+    }
+
+    for(u32 by = r.minY / DEPTH_BLOCK_SIZE; by <= (u32)(r.maxY - 1) / DEPTH_BLOCK_SIZE; by++)
+    {
+        for(u32 bx = r.minX / DEPTH_BLOCK_SIZE; bx <= (u32)(r.maxX - 1) / DEPTH_BLOCK_SIZE; bx++)
+        {
+            RasterRect blockRect = {(i32)(bx * DEPTH_BLOCK_SIZE), (i32)(by * DEPTH_BLOCK_SIZE),
+                                    (i32)((bx + 1) * DEPTH_BLOCK_SIZE), (i32)((by + 1) * DEPTH_BLOCK_SIZE)};
+            RasterRect onScreen = Raster_intersectRect(blockRect, screen);
+            RasterRect cleared = Raster_intersectRect(onScreen, r);
+
+            // Fully cleared blocks are known exactly, partial ones are rescanned
+            if(cleared.minX == onScreen.minX && cleared.minY == onScreen.minY &&
+               cleared.maxX == onScreen.maxX && cleared.maxY == onScreen.maxY)
+            {
+                depth->blockMin[by * depth->blocksX + bx] = value;
+                depth->blockMax[by * depth->blocksX + bx] = value;
+            }
+            else
+            {
+                Raster_updateDepthBlock(*depth, buffer, bx, by);
+            }
+        }
+    }
+
+    for(u32 ty = r.minY / DEPTH_TILE_SIZE; ty <= (u32)(r.maxY - 1) / DEPTH_TILE_SIZE; ty++)
+    {
+        for(u32 tx = r.minX / DEPTH_TILE_SIZE; tx <= (u32)(r.maxX - 1) / DEPTH_TILE_SIZE; tx++)
+            Raster_updateDepthTile(*depth, tx, ty);
+    }
+}
+
+static float Raster_depthAt(TriangleSetup &setup, i32 x, i32 y)
+{
+    return setup.zStepX * (float) x + (setup.zStepY * (float) y + setup.zOrigin);
+}
+
+void Raster_fillTriangle(FrameBuffer &buffer, TriangleSetup &setup, RasterRect clip, u32 color)
+{
+    RasterRect screen = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    RasterRect r = Raster_intersectRect(Raster_intersectRect(setup.bounds, clip), screen);
+
+    if(r.minX >= r.maxX || r.minY >= r.maxY)
+        return;
+
+    // Without an attached depth buffer the depth test is skipped
+    DepthBuffer *depth = setup.depthTest ? buffer.depth : nullptr;
+
+    BlockKernel kernel = Raster_blockScalar;
+#ifdef SIMD_X86
+    if(simdLevel >= SIMD_AVX2)
+        kernel = Raster_blockAVX2;
+    else if(simdLevel >= SIMD_SSE2)
+        kernel = Raster_blockSSE2;
+#endif
+
+    const i32 BLOCK = DEPTH_BLOCK_SIZE;
+    const i32 TILE = DEPTH_TILE_SIZE;
+
+    for(i32 ty = r.minY / TILE; ty <= (r.maxY - 1) / TILE; ty++)
+    {
+        for(i32 tx = r.minX / TILE; tx <= (r.maxX - 1) / TILE; tx++)
+        {
+            // Coarsest level: the whole tile is already in front
+            if(depth && setup.zMin >= depth->tileMax[ty * depth->tilesX + tx])
+                continue;
+
+            RasterRect tileRect = {tx * TILE, ty * TILE, (tx + 1) * TILE, (ty + 1) * TILE};
+            RasterRect tr = Raster_intersectRect(tileRect, r);
+            bool tileWritten = false;
+
+            for(i32 by = tr.minY / BLOCK; by <= (tr.maxY - 1) / BLOCK; by++)
+            {
+                for(i32 bx = tr.minX / BLOCK; bx <= (tr.maxX - 1) / BLOCK; bx++)
+                {
+                    RasterBlock block;
+                    block.x = bx * BLOCK;
+                    block.y = by * BLOCK;
+
+                    RasterRect blockRect = {block.x, block.y, block.x + BLOCK, block.y + BLOCK};
+                    block.rect = Raster_intersectRect(blockRect, tr);
+
+                    // Trivial reject when one edge is negative at every corner
+                    bool outside = false;
+                    for(int i = 0; i < 3 && !outside; i++)
+                    {
+                        i64 e = setup.origin[i] + setup.stepX[i] * block.x + setup.stepY[i] * block.y;
+                        i64 maxE = e + (setup.stepX[i] > 0 ? setup.stepX[i] * (BLOCK - 1) : 0)
+                                     + (setup.stepY[i] > 0 ? setup.stepY[i] * (BLOCK - 1) : 0);
+                        outside = maxE < 0;
+                    }
+
+                    if(outside)
+                        continue;
+
+                    block.depthTest = depth != nullptr;
+                    block.depthAlwaysPasses = false;
+
+                    if(depth)
+                    {
+                        // The plane is linear, so its extremes over the block are at the corners
+                        float z00 = Raster_depthAt(setup, block.x, block.y);
+                        float z10 = Raster_depthAt(setup, block.x + BLOCK - 1, block.y);
+                        float z01 = Raster_depthAt(setup, block.x, block.y + BLOCK - 1);
+                        float z11 = Raster_depthAt(setup, block.x + BLOCK - 1, block.y + BLOCK - 1);
+
+                        float nearZ = fmaxf(fminf(fminf(z00, z10), fminf(z01, z11)), setup.zMin);
+                        float farZ = fminf(fmaxf(fmaxf(z00, z10), fmaxf(z01, z11)), setup.zMax);
+                        float margin = RASTER_DEPTH_MARGIN * (fabsf(nearZ) + fabsf(farZ));
+
+                        u32 blockIndex = by * depth->blocksX + bx;
+
+                        if(nearZ - margin >= depth->blockMax[blockIndex])
+                            continue;
+
+                        block.depthAlwaysPasses = farZ + margin < depth->blockMin[blockIndex];
+
+                        for(i32 row = 0; row < BLOCK; row++)
+                            block.zRow[row] = setup.zStepY * (float)(block.y + row) + setup.zOrigin;
+                    }
+
+                    BlockKernel blockKernel = block.x + BLOCK <= (i32) buffer.width ? kernel : Raster_blockScalar;
+
+                    if(blockKernel(buffer, setup, block, color) && depth)
+                    {
+                        Raster_updateDepthBlock(*depth, buffer, bx, by);
+                        tileWritten = true;
+                    }
+                }
+            }
+
+            if(tileWritten)
+                Raster_updateDepthTile(*depth, tx, ty);
+        }
+    }
+}
+
+// Clipped 2D primitives. Each one draws exactly the pixels its unclipped
+// Graphics_* counterpart would, restricted to the clip rect, so a frame
+// split into tiles matches the frame drawn in one pass.
+
+static RasterRect Raster_screenClip(FrameBuffer &buffer, RasterRect clip)
+{
+    RasterRect screen = {0, 0, (i32) buffer.width, (i32) buffer.height};
+    return Raster_intersectRect(clip, screen);
+}
+
+void Raster_fillRect(FrameBuffer &buffer, RasterRect rect, RasterRect clip, u32 color)
+{
+    RasterRect r = Raster_intersectRect(rect, Raster_screenClip(buffer, clip));
+
+    if(r.minX >= r.maxX || r.minY >= r.maxY)
+        return;
+
+    // Full-width rows are contiguous, fill them as a single span
+    if(r.minX == 0 && r.maxX == (i32) buffer.width)
+    {
+        Span_fill(buffer.buffer + (size_t) r.minY * buffer.width, (size_t)(r.maxY - r.minY) * buffer.width, color);
+        return;
+    }
+
+    for(i32 y = r.minY; y < r.maxY; y++)
+        Span_fill(buffer.buffer + (size_t) y * buffer.width + r.minX, r.maxX - r.minX, color);
+}
+
+void Raster_outlineRect(FrameBuffer &buffer, RasterRect rect, RasterRect clip, u32 color)
+{
+    if(rect.minX >= rect.maxX || rect.minY >= rect.maxY)
+        return;
+
+    RasterRect top    = {rect.minX, rect.minY, rect.maxX, rect.minY + 1};
+    RasterRect bottom = {rect.minX, rect.maxY - 1, rect.maxX, rect.maxY};
+    RasterRect left   = {rect.minX, rect.minY, rect.minX + 1, rect.maxY};
+    RasterRect right  = {rect.maxX - 1, rect.minY, rect.maxX, rect.maxY};
+
+    Raster_fillRect(buffer, top, clip, color);
+    Raster_fillRect(buffer, bottom, clip, color);
+    Raster_fillRect(buffer, left, clip, color);
+    Raster_fillRect(buffer, right, clip, color);
+}
+
+void Raster_grid(FrameBuffer &buffer, i32 step, GRID_MODE mode, RasterRect clip)
+{
+    const u32 WHITE = 0xFFFFFFFF;
+    const u32 DARK_GRAY = 0xFF404040;
+
+    if(step <= 0)
+        return;
+
+    RasterRect r = Raster_screenClip(buffer, clip);
+
+    if(r.minX >= r.maxX)
+        return;
+
+    // First multiple of step inside the clip
+    i32 firstX = r.minX + (step - r.minX % step) % step;
+
+    for(i32 y = r.minY; y < r.maxY; y++)
+    {
+        u32 *row = buffer.buffer + (size_t) y * buffer.width;
+        bool onRow = y % step == 0;
+
+        if(mode == LINES)
+        {
+            // Horizontal lines are whole spans, vertical ones a strided column set
+            if(onRow)
+                Span_fill(row + r.minX, r.maxX - r.minX, DARK_GRAY);
+            else if(firstX < r.maxX)
+                Span_fillStrided(row + firstX, r.maxX - firstX, step, DARK_GRAY);
+        }
+        else if(onRow && firstX < r.maxX)
+        {
+            Span_fillStrided(row + firstX, r.maxX - firstX, step, WHITE);
+        }
+    }
+}
+
+static i64 Raster_floorDiv(i64 a, i64 b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static i64 Raster_ceilDiv(i64 a, i64 b)
+{
+    return -Raster_floorDiv(-a, b);
+}
+
+// Range of major-axis steps [kStart, kEnd] that lands inside the clip, false when empty
+static bool Raster_clipLineSteps(RasterRect r, bool xMajor, i64 major, i64 minor, i64 majorStart, i64 minorStart,
+                                 i32 majorSign, i32 minorSign, i64 &kStart, i64 &kEnd)
+{
+    i64 majorLo = xMajor ? r.minX : r.minY;
+    i64 majorHi = xMajor ? r.maxX - 1 : r.maxY - 1;
+    i64 minorLo = xMajor ? r.minY : r.minX;
+    i64 minorHi = xMajor ? r.maxY - 1 : r.maxX - 1;
+
+    // Steps whose major coordinate is inside the clip
+    kStart = majorSign > 0 ? majorLo - majorStart : majorStart - majorHi;
+    kEnd = majorSign > 0 ? majorHi - majorStart : majorStart - majorLo;
+
+    // Minor advance allowed by the clip
+    i64 mLo = minorSign > 0 ? minorLo - minorStart : minorStart - minorHi;
+    i64 mHi = minorSign > 0 ? minorHi - minorStart : minorStart - minorLo;
+
+    if(mLo < 0) mLo = 0;
+    if(mHi > minor) mHi = minor;
+    if(mLo > mHi)
+        return false;
+
+    if(minor > 0)
+    {
+        i64 kFirst = Raster_ceilDiv(2 * major * mLo - major + 1, 2 * minor);
+        i64 kLast = Raster_floorDiv(2 * major * (mHi + 1) - major, 2 * minor);
+        if(kFirst > kStart) kStart = kFirst;
+        if(kLast < kEnd) kEnd = kLast;
+    }
+
+    if(kStart < 0) kStart = 0;
+    if(kEnd > major) kEnd = major;
+    if(kStart > kEnd)
+        return false;
+
+    return true;
+}
+
+// Bresenham's line algorithm, clipped analytically before the walk. After
+// k steps along the major axis the minor axis has advanced
+// floor((2 * k * minor + major - 1) / (2 * major)) pixels, exactly what
+// the incremental error term produces, so the clip rect's slice of the
+// line is found in closed form and walked with no per-pixel checks. The
+// same formula also gives identical pixels whichever tile draws them.
+// Endpoints must stay within 2^29 pixels so the 64-bit products cannot overflow.
+void Raster_line(FrameBuffer &buffer, i32 x0, i32 y0, i32 x1, i32 y1, RasterRect clip, u32 color)
+{
+    RasterRect r = Raster_screenClip(buffer, clip);
+
+    if(r.minX >= r.maxX || r.minY >= r.maxY)
+        return;
+
+    // Trivial reject on the bounding box
+    if((x0 < r.minX && x1 < r.minX) || (x0 >= r.maxX && x1 >= r.maxX) ||
+       (y0 < r.minY && y1 < r.minY) || (y0 >= r.maxY && y1 >= r.maxY))
+        return;
+
+    i64 dx = x1 > x0 ? (i64) x1 - x0 : (i64) x0 - x1;
+    i64 dy = y1 > y0 ? (i64) y1 - y0 : (i64) y0 - y1;
+    i32 sx = x0 < x1 ? 1 : -1;
+    i32 sy = y0 < y1 ? 1 : -1;
+
+    if(dx == 0 && dy == 0)
+    {
+        buffer.buffer[(size_t) y0 * buffer.width + x0] = color;
+        return;
+    }
+
+    // Fold the octants onto major/minor axes
+    bool xMajor = dx >= dy;
+    i64 major = xMajor ? dx : dy;
+    i64 minor = xMajor ? dy : dx;
+    i64 majorStart = xMajor ? x0 : y0;
+    i64 minorStart = xMajor ? y0 : x0;
+    i32 majorSign = xMajor ? sx : sy;
+    i32 minorSign = xMajor ? sy : sx;
+    i64 kStart = 0;
+    i64 kEnd = major;
+
+    bool inside = x0 >= r.minX && x1 >= r.minX && x0 < r.maxX && x1 < r.maxX &&
+                  y0 >= r.minY && y1 >= r.minY && y0 < r.maxY && y1 < r.maxY;
+
+    // Lines fully inside the clip, the common case, skip the divides
+    if(!inside && !Raster_clipLineSteps(r, xMajor, major, minor, majorStart, minorStart, majorSign, minorSign, kStart, kEnd))
+        return;
+
+    // Minor advance and error term at the first drawn step, m = 0 at the start point
+    i64 m = 0;
+    i64 error = major - 1;
+
+    if(kStart > 0)
+    {
+        i64 numerator = 2 * kStart * minor + major - 1;
+        m = numerator / (2 * major);
+        error = numerator - m * 2 * major;
+    }
+
+    i64 x = xMajor ? x0 + sx * kStart : x0 + sx * m;
+    i64 y = xMajor ? y0 + sy * m : y0 + sy * kStart;
+
+    ptrdiff_t pitch = (ptrdiff_t) buffer.width;
+    ptrdiff_t majorDelta = xMajor ? sx : sy * pitch;
+    ptrdiff_t minorDelta = xMajor ? sy * pitch : sx;
+
+    u32 *pixel = buffer.buffer + y * pitch + x;
+    i64 errorStep = 2 * minor;
+    i64 errorWrap = 2 * major;
+
+    // The pointer only advances while another pixel follows, never past the clip
+    for(i64 k = kStart; ; )
+    {
+        *pixel = color;
+
+        if(++k > kEnd)
+            break;
+
+        pixel += majorDelta;
+
+        error += errorStep;
+        if(error >= errorWrap)
+        {
+            error -= errorWrap;
+            pixel += minorDelta;
+        }
+    }
+}
+
+void Raster_lines(FrameBuffer &buffer, const LineSegment *lines, u32 count, RasterRect clip)
+{
+    for(u32 i = 0; i < count; i++)
+        Raster_line(buffer, lines[i].x0, lines[i].y0, lines[i].x1, lines[i].y1, clip, lines[i].color);
+}
+
+RasterRect Raster_lineBounds(i32 x0, i32 y0, i32 x1, i32 y1)
+{
+    RasterRect bounds;
+    bounds.minX = x0 < x1 ? x0 : x1;
+    bounds.minY = y0 < y1 ? y0 : y1;
+    bounds.maxX = (x0 > x1 ? x0 : x1) + 1;
+    bounds.maxY = (y0 > y1 ? y0 : y1) + 1;
+    return bounds;
+}
+
+// Destination rect of a blit after the framebuffer edge adjustment
+RasterRect Raster_blitRect(FrameBuffer &buffer, int x, int y, int w, int h)
+{
+    int destX = x;
+    int destY = y;
+    int destW = w;
+    int destH = h;
+
+    if (destX < 0)
+    {
+        destW += destX;
+        destX = 0;
+    }
+    if (destY < 0)
+    {
+        destH += destY;
+        destY = 0;
+    }
+    if (destX + destW > (int) buffer.width)
+    {
+        destW = buffer.width - destX;
+    }
+    if (destY + destH > (int) buffer.height)
+    {
+        destH = buffer.height - destY;
+    }
+
+    RasterRect result = {destX, destY, destX + destW, destY + destH};
+    return result;
+}
+
+void Raster_blit(FrameBuffer &buffer, u32 *imgPixels, int imgW, int imgH, int x, int y, int w, int h, BLIT_MODE mode, RasterRect clip)
+{
+    RasterRect dest = Raster_blitRect(buffer, x, y, w, h);
+    RasterRect r = Raster_intersectRect(dest, Raster_screenClip(buffer, clip));
+
+    if(r.minX >= r.maxX || r.minY >= r.maxY)
+        return;
+
+    // Source texel of destination pixel i is i * size / w, exact integer
+    // division from the destination origin, so every tile picks the same
+    // columns and rows as one pass
+    i32 spanWidth = r.maxX - r.minX;
+    bool scaled = imgW != w;
+
+    // Source column of every destination pixel, built once per blit.
+    // Per thread, tiles blit concurrently.
+    thread_local std::vector<i32> columns;
+    thread_local std::vector<u32> scaledRow;
+
+    if(scaled)
+    {
+        columns.resize(spanWidth);
+        scaledRow.resize(spanWidth);
+
+        i64 first = r.minX - dest.minX;
+        for(i32 i = 0; i < spanWidth; i++)
+            columns[i] = (i32)((first + i) * imgW / w);
+    }
+
+    // Image coordinates are relative to the adjusted destination origin
+    i64 previousSource = -1;
+    for (int py = r.minY; py < r.maxY; ++py)
+    {
+        i64 sourceRow = (i64)(py - dest.minY) * imgH / h;
+        const u32 *source = imgPixels + sourceRow * imgW;
+        u32 *row = buffer.buffer + (size_t) py * buffer.width + r.minX;
+
+        if(mode == BLIT_COPY)
+        {
+            // Magnified rows repeat the row above
+            if(sourceRow == previousSource)
+                memcpy(row, row - buffer.width, spanWidth * sizeof(u32));
+            else if(scaled)
+                Span_gather(row, source, columns.data(), spanWidth);
+            else
+                memcpy(row, source + (r.minX - dest.minX), spanWidth * sizeof(u32));
+
+            previousSource = sourceRow;
+            continue;
+        }
+
+        // Composited rows are resampled once into a scratch row, magnified
+        // rows reuse it
+        const u32 *pixels = source + (r.minX - dest.minX);
+        if(scaled)
+        {
+            if(sourceRow != previousSource)
+                Span_gather(scaledRow.data(), source, columns.data(), spanWidth);
+
+            pixels = scaledRow.data();
+        }
+
+        if(mode == BLIT_ALPHA_TEST)
+            Span_alphaTest(row, pixels, spanWidth);
+        else
+            Span_blend(row, pixels, spanWidth);
+
+        previousSource = sourceRow;
+    }
+}
+
+// Filtered blit of the whole texture to x, y, w, h. The mip level follows the
+// scale, and every pixel samples at its centre relative to the unclipped rect.
+void Raster_blitTexture(FrameBuffer &buffer, const Texture &texture, int x, int y, int w, int h, TEXTURE_FILTER filter, RasterRect clip)
+{
+    if(w <= 0 || h <= 0)
+        return;
+
+    RasterRect dest = {x, y, x + w, y + h};
+    RasterRect r = Raster_intersectRect(dest, Raster_screenClip(buffer, clip));
+
+    if(r.minX >= r.maxX || r.minY >= r.maxY)
+        return;
+
+    float du = 1.0f / w;
+    float dv = 1.0f / h;
+    float lod = Texture_lod(texture, du, dv);
+
+    for(i32 py = r.minY; py < r.maxY; py++)
+    {
+        float v = (py - y + 0.5f) * dv;
+        u32 *row = buffer.buffer + (size_t) py * buffer.width + r.minX;
+        Texture_sampleRow(texture, filter, lod, 0.5f * du, v, du, 0.0f, r.minX - x, r.maxX - r.minX, row);
+    }
+}
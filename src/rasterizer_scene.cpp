@@ -0,0 +1,113 @@
+#include "rasterizer_scene.h"
+#include "rasterizer_trace.h"
+
+#include <algorithm>
+
+static void Scene_markDirty(SceneGraph &scene, u32 node)
+{
+    if(scene.flags[node] & SCENE_DIRTY)
+        return;
+
+    scene.flags[node] |= SCENE_DIRTY;
+    scene.dirty.push_back(node);
+}
+
+u32 Scene_addNode(SceneGraph &scene, u32 parent)
+{
+    u32 node = (u32) scene.parent.size();
+
+    scene.parent.push_back(parent);
+    scene.firstChild.push_back(SCENE_NONE);
+    scene.nextSibling.push_back(SCENE_NONE);
+
+    if(parent != SCENE_NONE)
+    {
+        scene.nextSibling[node] = scene.firstChild[parent];
+        scene.firstChild[parent] = node;
+    }
+
+    scene.position.push_back({0, 0, 0});
+    scene.rotation.push_back({0, 0, 0});
+    scene.scale.push_back({1, 1, 1});
+    scene.local.push_back(Math_identity());
+    scene.world.push_back(Math_identity());
+    scene.flags.push_back(0);
+
+    Scene_markDirty(scene, node);
+    return node;
+}
+
+void Scene_clear(SceneGraph &scene)
+{
+    scene = {};
+}
+
+void Scene_setPosition(SceneGraph &scene, u32 node, Vector3 position)
+{
+    scene.position[node] = position;
+    Scene_markDirty(scene, node);
+}
+
+void Scene_setRotation(SceneGraph &scene, u32 node, Vector3 degrees)
+{
+    scene.rotation[node] = degrees;
+    Scene_markDirty(scene, node);
+}
+
+void Scene_setScale(SceneGraph &scene, u32 node, Vector3 scale)
+{
+    scene.scale[node] = scale;
+    Scene_markDirty(scene, node);
+}
+
+// Depth-first from root, children after their parent. Descendants that
+// were flagged themselves get their local matrix here too, which clears
+// them from the rest of the dirty list.
+static void Scene_updateSubtree(SceneGraph &scene, u32 root)
+{
+    scene.stack.clear();
+    scene.stack.push_back(root);
+
+    while(!scene.stack.empty())
+    {
+        u32 node = scene.stack.back();
+        scene.stack.pop_back();
+
+        if(scene.flags[node] & SCENE_DIRTY)
+        {
+            scene.local[node] = Math_model(scene.position[node], scene.rotation[node], scene.scale[node]);
+            scene.flags[node] &= ~SCENE_DIRTY;
+        }
+
+        u32 parent = scene.parent[node];
+        scene.world[node] = parent == SCENE_NONE ? scene.local[node] : Math_multiply(scene.world[parent], scene.local[node]);
+        scene.updated++;
+
+        for(u32 child = scene.firstChild[node]; child != SCENE_NONE; child = scene.nextSibling[child])
+            scene.stack.push_back(child);
+    }
+}
+
+void Scene_update(SceneGraph &scene)
+{
+    TRACE_FUNCTION();
+
+    scene.updated = 0;
+
+    // Ancestors have lower indices, so in index order a flagged node is
+    // reached before any flagged node below it and each subtree is rebuilt once
+    std::sort(scene.dirty.begin(), scene.dirty.end());
+
+    for(u32 node : scene.dirty)
+    {
+        if(scene.flags[node] & SCENE_DIRTY)
+            Scene_updateSubtree(scene, node);
+    }
+
+    scene.dirty.clear();
+}
+
+const Matrix4& Scene_world(const SceneGraph &scene, u32 node)
+{
+    return scene.world[node];
+}
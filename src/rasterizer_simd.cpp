@@ -0,0 +1,213 @@
+#include "rasterizer_simd.h"
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+CpuFeatures   cpuFeatures = {};
+SIMD_LEVEL    simdLevel   = SIMD_SCALAR;
+ClearFunction Simd_clear  = Simd_clearScalar;
+
+#ifdef SIMD_X86
+
+static void Simd_cpuid(int leaf, int subleaf, int regs[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex(regs, leaf, subleaf);
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+#endif
+}
+
+// Which register state the OS saves on context switch (XCR0)
+static unsigned long long Simd_xgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long) hi << 32) | lo;
+#endif
+}
+
+static CpuFeatures Simd_detectCPU()
+{
+    CpuFeatures features = {};
+    int regs[4];
+
+    Simd_cpuid(0, 0, regs);
+    int maxLeaf = regs[0];
+
+    Simd_cpuid(1, 0, regs);
+    features.sse2  = (regs[3] & (1 << 26)) != 0;
+    features.sse41 = (regs[2] & (1 << 19)) != 0;
+
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx     = (regs[2] & (1 << 28)) != 0;
+    bool fma     = (regs[2] & (1 << 12)) != 0;
+
+    if(!osxsave || !avx || maxLeaf < 7)
+        return features;
+
+    unsigned long long xcr0 = Simd_xgetbv();
+    bool ymmState = (xcr0 & 0x06) == 0x06;
+    bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+    Simd_cpuid(7, 0, regs);
+    features.avx2    = ymmState && (regs[1] & (1 << 5)) != 0;
+    features.fma     = ymmState && fma;
+    features.avx512f = zmmState && (regs[1] & (1 << 16)) != 0;
+
+    return features;
+}
+
+#else
+
+static CpuFeatures Simd_detectCPU()
+{
+    CpuFeatures features = {};
+    return features;
+}
+
+#endif
+
+void Simd_setLevel(SIMD_LEVEL level)
+{
+    // Never go above what the CPU supports
+    if(level >= SIMD_AVX512 && !cpuFeatures.avx512f) level = SIMD_AVX2;
+    if(level >= SIMD_AVX2 && !cpuFeatures.avx2) level = SIMD_SSE2;
+    if(level >= SIMD_SSE2 && !cpuFeatures.sse2) level = SIMD_SCALAR;
+
+    simdLevel = level;
+
+    switch(level)
+    {
+        case SIMD_AVX512: Simd_clear = Simd_clearAVX512; break;
+        case SIMD_AVX2:   Simd_clear = Simd_clearAVX2;   break;
+        case SIMD_SSE2:   Simd_clear = Simd_clearSSE2;   break;
+        default:          Simd_clear = Simd_clearScalar; break;
+    }
+}
+
+void Simd_initialize()
+{
+    cpuFeatures = Simd_detectCPU();
+    Simd_setLevel(SIMD_AVX512);
+}
+
+const char *Simd_levelName(SIMD_LEVEL level)
+{
+    switch(level)
+    {
+        case SIMD_SSE2:   return "sse2";
+        case SIMD_AVX2:   return "avx2";
+        case SIMD_AVX512: return "avx512";
+        default:          return "scalar";
+    }
+}
+
+// Reference implementation, the wide kernels must match it exactly
+void Simd_clearScalar(u32 *dst, size_t count, u32 value)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        dst[i] = value;
+    }
+}
+
+#ifdef SIMD_X86
+
+// Scalar head up to the store alignment, streaming body, scalar tail
+static size_t Simd_alignHead(u32 *dst, size_t count, size_t alignment, u32 value)
+{
+    size_t head = ((alignment - ((size_t) dst & (alignment - 1))) & (alignment - 1)) / sizeof(u32);
+    if(head > count) head = count;
+
+    for(size_t i = 0; i < head; i++)
+        dst[i] = value;
+
+    return head;
+}
+
+SIMD_TARGET("sse2")
+void Simd_clearSSE2(u32 *dst, size_t count, u32 value)
+{
+    size_t i = Simd_alignHead(dst, count, 16, value);
+    __m128i v = _mm_set1_epi32((int) value);
+
+    for(; i + 16 <= count; i += 16)
+    {
+        _mm_stream_si128((__m128i*)(dst + i +  0), v);
+        _mm_stream_si128((__m128i*)(dst + i +  4), v);
+        _mm_stream_si128((__m128i*)(dst + i +  8), v);
+        _mm_stream_si128((__m128i*)(dst + i + 12), v);
+    }
+    for(; i + 4 <= count; i += 4)
+        _mm_stream_si128((__m128i*)(dst + i), v);
+
+    // Order the weakly-ordered streaming stores before later writes
+    _mm_sfence();
+
+    for(; i < count; i++)
+        dst[i] = value;
+}
+
+SIMD_TARGET("avx2")
+void Simd_clearAVX2(u32 *dst, size_t count, u32 value)
+{
+    size_t i = Simd_alignHead(dst, count, 32, value);
+    __m256i v = _mm256_set1_epi32((int) value);
+
+    for(; i + 32 <= count; i += 32)
+    {
+        _mm256_stream_si256((__m256i*)(dst + i +  0), v);
+        _mm256_stream_si256((__m256i*)(dst + i +  8), v);
+        _mm256_stream_si256((__m256i*)(dst + i + 16), v);
+        _mm256_stream_si256((__m256i*)(dst + i + 24), v);
+    }
+    for(; i + 8 <= count; i += 8)
+        _mm256_stream_si256((__m256i*)(dst + i), v);
+
+    _mm_sfence();
+
+    for(; i < count; i++)
+        dst[i] = value;
+}
+
+SIMD_TARGET("avx512f")
+void Simd_clearAVX512(u32 *dst, size_t count, u32 value)
+{
+    size_t i = Simd_alignHead(dst, count, 64, value);
+    __m512i v = _mm512_set1_epi32((int) value);
+
+    for(; i + 64 <= count; i += 64)
+    {
+        _mm512_stream_si512((__m512i*)(dst + i +  0), v);
+        _mm512_stream_si512((__m512i*)(dst + i + 16), v);
+        _mm512_stream_si512((__m512i*)(dst + i + 32), v);
+        _mm512_stream_si512((__m512i*)(dst + i + 48), v);
+    }
+    for(; i + 16 <= count; i += 16)
+        _mm512_stream_si512((__m512i*)(dst + i), v);
+
+    _mm_sfence();
+
+    for(; i < count; i++)
+        dst[i] = value;
+}
+
+#else
+
+void Simd_clearSSE2(u32 *dst, size_t count, u32 value)   { Simd_clearScalar(dst, count, value); }
+void Simd_clearAVX2(u32 *dst, size_t count, u32 value)   { Simd_clearScalar(dst, count, value); }
+void Simd_clearAVX512(u32 *dst, size_t count, u32 value) { Simd_clearScalar(dst, count, value); }
+
+#endif
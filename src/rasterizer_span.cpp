@@ -0,0 +1,515 @@
+#include "rasterizer_span.h"
+#include "rasterizer_simd.h"
+
+#include <string.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// x / 255 rounded, exact for x in [0, 255 * 255]
+static inline u32 Span_div255(u32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+void Span_fillScalar(u32 *dst, size_t count, u32 color)
+{
+    for(size_t i = 0; i < count; i++)
+        dst[i] = color;
+}
+
+void Span_gatherScalar(u32 *dst, const u32 *src, const i32 *columns, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+        dst[i] = src[columns[i]];
+}
+
+void Span_alphaTestScalar(u32 *dst, const u32 *src, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        if(src[i] >= 0x80000000)
+            dst[i] = src[i];
+    }
+}
+
+void Span_blendScalar(u32 *dst, const u32 *src, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        u32 s = src[i];
+        u32 inverse = 255 - (s >> 24);
+
+        if(inverse == 0)
+        {
+            dst[i] = s;
+            continue;
+        }
+
+        u32 d = dst[i];
+        u32 result = 0;
+
+        for(u32 shift = 0; shift < 32; shift += 8)
+        {
+            u32 channel = ((s >> shift) & 0xFF) + Span_div255(((d >> shift) & 0xFF) * inverse);
+            result |= (channel > 0xFF ? 0xFF : channel) << shift;
+        }
+
+        dst[i] = result;
+    }
+}
+
+void Span_swizzleRBScalar(u32 *dst, const u32 *src, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        u32 v = src[i];
+        dst[i] = (v & 0xFF00FF00) | ((v >> 16) & 0xFF) | ((v & 0xFF) << 16);
+    }
+}
+
+#ifdef SIMD_X86
+
+// Short runs are finished with one overlapping unaligned store instead of a scalar tail
+
+SIMD_TARGET("sse2")
+void Span_fillSSE2(u32 *dst, size_t count, u32 color)
+{
+    if(count < 4)
+    {
+        Span_fillScalar(dst, count, color);
+        return;
+    }
+
+    __m128i value = _mm_set1_epi32((int) color);
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i*)(dst + i), value);
+
+    if(i < count)
+        _mm_storeu_si128((__m128i*)(dst + count - 4), value);
+}
+
+SIMD_TARGET("avx2")
+void Span_fillAVX2(u32 *dst, size_t count, u32 color)
+{
+    if(count < 8)
+    {
+        Span_fillSSE2(dst, count, color);
+        return;
+    }
+
+    __m256i value = _mm256_set1_epi32((int) color);
+
+    // One unaligned head store, then aligned stores from the next 32-byte boundary
+    _mm256_storeu_si256((__m256i*) dst, value);
+    size_t i = (32 - ((size_t) dst & 31)) / sizeof(u32);
+
+    for(; i + 8 <= count; i += 8)
+        _mm256_store_si256((__m256i*)(dst + i), value);
+
+    if(i < count)
+        _mm256_storeu_si256((__m256i*)(dst + count - 8), value);
+}
+
+SIMD_TARGET("avx512f")
+void Span_fillAVX512(u32 *dst, size_t count, u32 color)
+{
+    __m512i value = _mm512_set1_epi32((int) color);
+
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+        _mm512_storeu_si512(dst + i, value);
+
+    // Masked tail, short spans never touch memory outside [0, count)
+    if(i < count)
+        _mm512_mask_storeu_epi32(dst + i, (__mmask16)((1u << (count - i)) - 1), value);
+}
+
+SIMD_TARGET("avx2")
+void Span_gatherAVX2(u32 *dst, const u32 *src, const i32 *columns, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i index = _mm256_loadu_si256((const __m256i*)(columns + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*) src, index, 4));
+    }
+
+    Span_gatherScalar(dst + i, src, columns + i, count - i);
+}
+
+SIMD_TARGET("avx512f")
+void Span_gatherAVX512(u32 *dst, const u32 *src, const i32 *columns, size_t count)
+{
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m512i index = _mm512_loadu_si512(columns + i);
+        _mm512_storeu_si512(dst + i, _mm512_i32gather_epi32(index, src, 4));
+    }
+
+    Span_gatherScalar(dst + i, src, columns + i, count - i);
+}
+
+// Scalar head up to the store alignment, streaming body with unaligned
+// loads, scalar tail. Returns the index of the first streamed pixel.
+// There is no fence per call, a frame's rows are fenced once.
+static size_t Span_copyHead(u32 *dst, const u32 *src, size_t count, size_t alignment)
+{
+    size_t head = ((alignment - ((size_t) dst & (alignment - 1))) & (alignment - 1)) / sizeof(u32);
+    if(head > count) head = count;
+
+    for(size_t i = 0; i < head; i++)
+        dst[i] = src[i];
+
+    return head;
+}
+
+SIMD_TARGET("sse2")
+void Span_copyStreamSSE2(u32 *dst, const u32 *src, size_t count)
+{
+    size_t i = Span_copyHead(dst, src, count, 16);
+
+    for(; i + 4 <= count; i += 4)
+        _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+
+    for(; i < count; i++)
+        dst[i] = src[i];
+}
+
+SIMD_TARGET("avx2")
+void Span_copyStreamAVX2(u32 *dst, const u32 *src, size_t count)
+{
+    size_t i = Span_copyHead(dst, src, count, 32);
+
+    for(; i + 8 <= count; i += 8)
+        _mm256_stream_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+
+    for(; i < count; i++)
+        dst[i] = src[i];
+}
+
+SIMD_TARGET("avx512f")
+void Span_copyStreamAVX512(u32 *dst, const u32 *src, size_t count)
+{
+    size_t i = Span_copyHead(dst, src, count, 64);
+
+    for(; i + 16 <= count; i += 16)
+        _mm512_stream_si512((__m512i*)(dst + i), _mm512_loadu_si512(src + i));
+
+    for(; i < count; i++)
+        dst[i] = src[i];
+}
+
+SIMD_TARGET("sse2")
+void Span_swizzleRBSSE2(u32 *dst, const u32 *src, size_t count)
+{
+    __m128i keep = _mm_set1_epi32((int) 0xFF00FF00);
+    __m128i low = _mm_set1_epi32(0xFF);
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+        __m128i b = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(r, b)));
+    }
+
+    Span_swizzleRBScalar(dst + i, src + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+void Span_swizzleRBAVX2(u32 *dst, const u32 *src, size_t count)
+{
+    __m256i order = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                     2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(v, order));
+    }
+
+    Span_swizzleRBScalar(dst + i, src + i, count - i);
+}
+
+// AVX-512F has no byte shuffle, the swap is done with shifts and a ternary select
+SIMD_TARGET("avx512f")
+void Span_swizzleRBAVX512(u32 *dst, const u32 *src, size_t count)
+{
+    __m512i keep = _mm512_set1_epi32((int) 0xFF00FF00);
+    __m512i low = _mm512_set1_epi32(0xFF);
+
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m512i v = _mm512_loadu_si512(src + i);
+        __m512i r = _mm512_and_si512(_mm512_srli_epi32(v, 16), low);
+        __m512i b = _mm512_slli_epi32(_mm512_and_si512(v, low), 16);
+
+        // (v & keep) | r | b
+        _mm512_storeu_si512(dst + i, _mm512_ternarylogic_epi32(_mm512_and_si512(v, keep), r, b, 0xFE));
+    }
+
+    Span_swizzleRBScalar(dst + i, src + i, count - i);
+}
+
+// Alpha >= 128 is the sign bit, so the write mask is an arithmetic shift
+SIMD_TARGET("sse2")
+void Span_alphaTestSSE2(u32 *dst, const u32 *src, size_t count)
+{
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i mask = _mm_srai_epi32(s, 31);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(mask, s), _mm_andnot_si128(mask, d)));
+    }
+
+    Span_alphaTestScalar(dst + i, src + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+void Span_alphaTestAVX2(u32 *dst, const u32 *src, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(d, s, _mm256_srai_epi32(s, 31)));
+    }
+
+    Span_alphaTestScalar(dst + i, src + i, count - i);
+}
+
+SIMD_TARGET("avx512f")
+void Span_alphaTestAVX512(u32 *dst, const u32 *src, size_t count)
+{
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m512i s = _mm512_loadu_si512(src + i);
+        _mm512_mask_storeu_epi32(dst + i, _mm512_cmplt_epi32_mask(s, _mm512_setzero_si512()), s);
+    }
+
+    Span_alphaTestScalar(dst + i, src + i, count - i);
+}
+
+// 4 channels of 2 pixels per register in 16-bit lanes, inverse alpha in all
+// four lanes of its pixel. Same rounding as Span_div255.
+SIMD_TARGET("sse2")
+static inline __m128i Span_scale8(__m128i channels, __m128i inverse)
+{
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(channels, inverse), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+SIMD_TARGET("sse2")
+void Span_blendSSE2(u32 *dst, const u32 *src, size_t count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i opaque = _mm_set1_epi32(255);
+
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i alpha = _mm_srli_epi32(s, 24);
+
+        // Fully opaque groups are a copy, fully empty ones leave dst alone
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, opaque)) == 0xFFFF)
+        {
+            _mm_storeu_si128((__m128i*)(dst + i), s);
+            continue;
+        }
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xFFFF)
+            continue;
+
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i inverse = _mm_sub_epi32(opaque, alpha);
+        inverse = _mm_or_si128(inverse, _mm_slli_epi32(inverse, 16));
+
+        __m128i lo = Span_scale8(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(inverse, inverse));
+        __m128i hi = Span_scale8(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(inverse, inverse));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+
+    Span_blendScalar(dst + i, src + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+static inline __m256i Span_scale8AVX2(__m256i channels, __m256i inverse)
+{
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(channels, inverse), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+SIMD_TARGET("avx2")
+void Span_blendAVX2(u32 *dst, const u32 *src, size_t count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i opaque = _mm256_set1_epi32(255);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i alpha = _mm256_srli_epi32(s, 24);
+
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, opaque)) == -1)
+        {
+            _mm256_storeu_si256((__m256i*)(dst + i), s);
+            continue;
+        }
+        if(_mm256_testz_si256(s, s))
+            continue;
+
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i inverse = _mm256_sub_epi32(opaque, alpha);
+        inverse = _mm256_or_si256(inverse, _mm256_slli_epi32(inverse, 16));
+
+        // Unpacks stay within 128-bit lanes on both sides, so pack restores the order
+        __m256i lo = Span_scale8AVX2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(inverse, inverse));
+        __m256i hi = Span_scale8AVX2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(inverse, inverse));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+    }
+
+    Span_blendScalar(dst + i, src + i, count - i);
+}
+
+#else
+
+void Span_fillSSE2(u32 *dst, size_t count, u32 color)   { Span_fillScalar(dst, count, color); }
+void Span_fillAVX2(u32 *dst, size_t count, u32 color)   { Span_fillScalar(dst, count, color); }
+void Span_fillAVX512(u32 *dst, size_t count, u32 color) { Span_fillScalar(dst, count, color); }
+void Span_gatherAVX2(u32 *dst, const u32 *src, const i32 *columns, size_t count)   { Span_gatherScalar(dst, src, columns, count); }
+void Span_gatherAVX512(u32 *dst, const u32 *src, const i32 *columns, size_t count) { Span_gatherScalar(dst, src, columns, count); }
+void Span_copyStreamSSE2(u32 *dst, const u32 *src, size_t count)   { memcpy(dst, src, count * sizeof(u32)); }
+void Span_copyStreamAVX2(u32 *dst, const u32 *src, size_t count)   { memcpy(dst, src, count * sizeof(u32)); }
+void Span_copyStreamAVX512(u32 *dst, const u32 *src, size_t count) { memcpy(dst, src, count * sizeof(u32)); }
+void Span_swizzleRBSSE2(u32 *dst, const u32 *src, size_t count)   { Span_swizzleRBScalar(dst, src, count); }
+void Span_swizzleRBAVX2(u32 *dst, const u32 *src, size_t count)   { Span_swizzleRBScalar(dst, src, count); }
+void Span_swizzleRBAVX512(u32 *dst, const u32 *src, size_t count) { Span_swizzleRBScalar(dst, src, count); }
+void Span_alphaTestSSE2(u32 *dst, const u32 *src, size_t count)   { Span_alphaTestScalar(dst, src, count); }
+void Span_alphaTestAVX2(u32 *dst, const u32 *src, size_t count)   { Span_alphaTestScalar(dst, src, count); }
+void Span_alphaTestAVX512(u32 *dst, const u32 *src, size_t count) { Span_alphaTestScalar(dst, src, count); }
+void Span_blendSSE2(u32 *dst, const u32 *src, size_t count)       { Span_blendScalar(dst, src, count); }
+void Span_blendAVX2(u32 *dst, const u32 *src, size_t count)       { Span_blendScalar(dst, src, count); }
+
+#endif
+
+void Span_fill(u32 *dst, size_t count, u32 color)
+{
+    // Large runs (full-width rects, clears) go through the streaming clear
+    if(count * sizeof(u32) >= SPAN_STREAM_THRESHOLD)
+    {
+        Simd_clear(dst, count, color);
+        return;
+    }
+
+    switch(simdLevel)
+    {
+        case SIMD_AVX512: Span_fillAVX512(dst, count, color); break;
+        case SIMD_AVX2:   Span_fillAVX2(dst, count, color);   break;
+        case SIMD_SSE2:   Span_fillSSE2(dst, count, color);   break;
+        default:          Span_fillScalar(dst, count, color); break;
+    }
+}
+
+void Span_gather(u32 *dst, const u32 *src, const i32 *columns, size_t count)
+{
+    switch(simdLevel)
+    {
+        case SIMD_AVX512: Span_gatherAVX512(dst, src, columns, count); break;
+        case SIMD_AVX2:   Span_gatherAVX2(dst, src, columns, count);   break;
+        default:          Span_gatherScalar(dst, src, columns, count); break;
+    }
+}
+
+void Span_copyStream(u32 *dst, const u32 *src, size_t count)
+{
+    switch(simdLevel)
+    {
+        case SIMD_AVX512: Span_copyStreamAVX512(dst, src, count); break;
+        case SIMD_AVX2:   Span_copyStreamAVX2(dst, src, count);   break;
+        case SIMD_SSE2:   Span_copyStreamSSE2(dst, src, count);   break;
+        default:          memcpy(dst, src, count * sizeof(u32));  break;
+    }
+}
+
+void Span_swizzleRB(u32 *dst, const u32 *src, size_t count)
+{
+    switch(simdLevel)
+    {
+        case SIMD_AVX512: Span_swizzleRBAVX512(dst, src, count); break;
+        case SIMD_AVX2:   Span_swizzleRBAVX2(dst, src, count);   break;
+        case SIMD_SSE2:   Span_swizzleRBSSE2(dst, src, count);   break;
+        default:          Span_swizzleRBScalar(dst, src, count); break;
+    }
+}
+
+void Span_alphaTest(u32 *dst, const u32 *src, size_t count)
+{
+    switch(simdLevel)
+    {
+        case SIMD_AVX512: Span_alphaTestAVX512(dst, src, count); break;
+        case SIMD_AVX2:   Span_alphaTestAVX2(dst, src, count);   break;
+        case SIMD_SSE2:   Span_alphaTestSSE2(dst, src, count);   break;
+        default:          Span_alphaTestScalar(dst, src, count); break;
+    }
+}
+
+// AVX-512F has no 16-bit multiply, AVX-512 machines run the AVX2 kernel
+void Span_blend(u32 *dst, const u32 *src, size_t count)
+{
+    switch(simdLevel)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2:   Span_blendAVX2(dst, src, count);   break;
+        case SIMD_SSE2:   Span_blendSSE2(dst, src, count);   break;
+        default:          Span_blendScalar(dst, src, count); break;
+    }
+}
+
+// Runs once per image at load time, there is no vector version
+void Span_premultiply(u32 *dst, const u32 *src, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        u32 v = src[i];
+        u32 alpha = v >> 24;
+        u32 result = v & 0xFF000000;
+
+        for(u32 shift = 0; shift < 24; shift += 8)
+            result |= Span_div255(((v >> shift) & 0xFF) * alpha) << shift;
+
+        dst[i] = result;
+    }
+}
+
+void Span_streamFence()
+{
+#ifdef SIMD_X86
+    _mm_sfence();
+#endif
+}
+
+void Span_fillStrided(u32 *dst, size_t count, i32 step, u32 color)
+{
+    if(step == 1)
+    {
+        Span_fill(dst, count, color);
+        return;
+    }
+
+    for(size_t i = 0; i < count; i += step)
+        dst[i] = color;
+}
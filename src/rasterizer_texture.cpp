@@ -0,0 +1,716 @@
+#include "rasterizer_texture.h"
+#include "rasterizer_simd.h"
+#include "rasterizer_vertex.h"
+#include "rasterizer_trace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+const char *textureCacheDirectory = "./texture_cache";
+
+// Each layout has its own blob
+static void Texture_cachePath(const char *path, TEXTURE_LAYOUT layout, char *result, size_t capacity)
+{
+    Cache_blobPath(textureCacheDirectory, path, layout == LAYOUT_BLOCKED ? "_blocked.tex" : ".tex", result, capacity);
+}
+
+static size_t Texture_pixelOffset(u32 pathLength)
+{
+    size_t offset = sizeof(TextureCacheHeader) + pathLength;
+    return (offset + TEXTURE_CACHE_ALIGNMENT - 1) & ~(size_t)(TEXTURE_CACHE_ALIGNMENT - 1);
+}
+
+static i32 Texture_blocks(i32 texels)
+{
+    return (texels + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+}
+
+// Texels stored for one level, blocked levels are padded to whole blocks
+static size_t Texture_levelTexels(i32 width, i32 height, TEXTURE_LAYOUT layout)
+{
+    if(layout == LAYOUT_BLOCKED)
+        return (size_t) Texture_blocks(width) * Texture_blocks(height) * TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE;
+
+    return (size_t) width * height;
+}
+
+// Pixel offsets of every level inside one chain block, returns the block size in bytes
+static size_t Texture_chainLayout(i32 width, i32 height, TEXTURE_LAYOUT layout, size_t offsets[TEXTURE_MAX_LEVELS], u32 &levelCount)
+{
+    const size_t LEVEL_ALIGNMENT = TEXTURE_CACHE_ALIGNMENT / sizeof(u32);
+
+    size_t offset = 0;
+    levelCount = 0;
+
+    while(levelCount < TEXTURE_MAX_LEVELS)
+    {
+        offsets[levelCount++] = offset;
+        offset += (Texture_levelTexels(width, height, layout) + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+
+        if(width == 1 && height == 1)
+            break;
+
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    return offset * sizeof(u32);
+}
+
+static void Texture_assignLevels(Texture &texture, u32 *base, i32 width, i32 height, TEXTURE_LAYOUT layout)
+{
+    size_t offsets[TEXTURE_MAX_LEVELS];
+    Texture_chainLayout(width, height, layout, offsets, texture.levelCount);
+
+    for(u32 level = 0; level < texture.levelCount; level++)
+    {
+        texture.levels[level].pixels = base + offsets[level];
+        texture.levels[level].width = width;
+        texture.levels[level].height = height;
+        texture.levels[level].blocksPerRow = layout == LAYOUT_BLOCKED ? Texture_blocks(width) : 0;
+
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    texture.pixels = base;
+    texture.width = texture.levels[0].width;
+    texture.height = texture.levels[0].height;
+    texture.layout = layout;
+}
+
+// 2x2 box filter with rounding, edge texels repeat on odd sizes
+static void Texture_buildLevel(const TextureLevel &src, TextureLevel &dst)
+{
+    for(i32 y = 0; y < dst.height; y++)
+    {
+        const u32 *row0 = src.pixels + (size_t)(y * 2) * src.width;
+        const u32 *row1 = src.pixels + (size_t)(y * 2 + 1 < src.height ? y * 2 + 1 : y * 2) * src.width;
+
+        for(i32 x = 0; x < dst.width; x++)
+        {
+            i32 x0 = x * 2;
+            i32 x1 = x0 + 1 < src.width ? x0 + 1 : x0;
+            u32 a = row0[x0], b = row0[x1], c = row1[x0], d = row1[x1];
+            u32 result = 0;
+
+            for(u32 shift = 0; shift < 32; shift += 8)
+            {
+                u32 sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+                result |= ((sum + 2) >> 2) << shift;
+            }
+
+            dst.pixels[(size_t) y * dst.width + x] = result;
+        }
+    }
+}
+
+// Row-major level to 4x4 blocks. Padding repeats the edge texels.
+static void Texture_blockLevel(const TextureLevel &src, TextureLevel &dst)
+{
+    i32 blocksHigh = Texture_blocks(src.height);
+
+    for(i32 by = 0; by < blocksHigh; by++)
+    {
+        for(i32 bx = 0; bx < dst.blocksPerRow; bx++)
+        {
+            u32 *block = dst.pixels + ((size_t) by * dst.blocksPerRow + bx) * TEXTURE_BLOCK_SIZE * TEXTURE_BLOCK_SIZE;
+
+            for(i32 y = 0; y < TEXTURE_BLOCK_SIZE; y++)
+            {
+                i32 sy = by * TEXTURE_BLOCK_SIZE + y;
+                const u32 *row = src.pixels + (size_t)(sy < src.height ? sy : src.height - 1) * src.width;
+
+                for(i32 x = 0; x < TEXTURE_BLOCK_SIZE; x++)
+                {
+                    i32 sx = bx * TEXTURE_BLOCK_SIZE + x;
+                    block[y * TEXTURE_BLOCK_SIZE + x] = row[sx < src.width ? sx : src.width - 1];
+                }
+            }
+        }
+    }
+}
+
+static bool Texture_validBlob(const u8 *blob, size_t size, const char *path, CacheSource source, TEXTURE_LAYOUT layout)
+{
+    if(size < sizeof(TextureCacheHeader))
+        return false;
+
+    TextureCacheHeader header;
+    memcpy(&header, blob, sizeof(header));
+
+    size_t pathLength = strlen(path);
+
+    if(header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION)
+        return false;
+
+    if(header.sourceSize != source.size || header.sourceTime != source.time)
+        return false;
+
+    if(header.width <= 0 || header.height <= 0 || header.pathLength != pathLength || header.layout != (u32) layout)
+        return false;
+
+    if(header.pixelOffset != Texture_pixelOffset(header.pathLength))
+        return false;
+
+    size_t offsets[TEXTURE_MAX_LEVELS];
+    u32 levelCount;
+    u64 end = header.pixelOffset + (u64) Texture_chainLayout(header.width, header.height, layout, offsets, levelCount);
+
+    if(header.levelCount != levelCount || end > size)
+        return false;
+
+    return memcmp(blob + sizeof(header), path, pathLength) == 0;
+}
+
+static bool Texture_loadCache(const char *path, CacheSource source, TEXTURE_LAYOUT layout, Texture &texture)
+{
+    char filename[CACHE_PATH_SIZE];
+    Texture_cachePath(path, layout, filename, sizeof(filename));
+
+    size_t size;
+    u8 *blob = (u8*) Cache_mapFile(filename, true, size);
+
+    if(!blob)
+        return false;
+
+    if(!Texture_validBlob(blob, size, path, source, layout))
+    {
+        Cache_unmapFile(blob, size);
+        return false;
+    }
+
+    TextureCacheHeader header;
+    memcpy(&header, blob, sizeof(header));
+
+    Texture_assignLevels(texture, (u32*)(blob + header.pixelOffset), header.width, header.height, layout);
+    texture.storage = TEXTURE_MAPPED;
+    texture.mapping = blob;
+    texture.mappingSize = size;
+    return true;
+}
+
+bool Texture_storeCache(const char *path, CacheSource source, const Texture &texture)
+{
+    TRACE_FUNCTION();
+
+    char filename[CACHE_PATH_SIZE];
+    Texture_cachePath(path, texture.layout, filename, sizeof(filename));
+
+    TextureCacheHeader header = {};
+    header.magic = TEXTURE_CACHE_MAGIC;
+    header.version = TEXTURE_CACHE_VERSION;
+    header.sourceSize = source.size;
+    header.sourceTime = source.time;
+    header.width = texture.width;
+    header.height = texture.height;
+    header.layout = texture.layout;
+    header.levelCount = texture.levelCount;
+    header.pathLength = (u32) strlen(path);
+    header.pixelOffset = (u32) Texture_pixelOffset(header.pathLength);
+
+    CacheWriter writer;
+    if(!Cache_beginWrite(writer, textureCacheDirectory, filename))
+        return false;
+
+    size_t offsets[TEXTURE_MAX_LEVELS];
+    u32 levelCount;
+    size_t pixelBytes = Texture_chainLayout(texture.width, texture.height, texture.layout, offsets, levelCount);
+
+    bool written = Cache_write(writer, 0, &header, sizeof(header)) &&
+                   Cache_write(writer, sizeof(header), path, header.pathLength) &&
+                   Cache_write(writer, header.pixelOffset, texture.pixels, pixelBytes);
+
+    return Cache_endWrite(writer, written);
+}
+
+int Texture_load(const char *path, Texture &texture, TEXTURE_LAYOUT layout)
+{
+    TRACE_FUNCTION();
+
+    texture = {};
+
+    CacheSource source;
+    bool stated = Cache_statSource(path, source);
+
+    if(stated && Texture_loadCache(path, source, layout, texture))
+        return 1;
+
+    u32 *pixels;
+    i32 width, height;
+
+    if(!Graphics_loadImage(path, &pixels, &width, &height))
+        return 0;
+
+    bool created = Texture_create(texture, pixels, width, height, layout);
+    free(pixels);
+
+    if(!created)
+        return 0;
+
+    if(!stated || !Texture_storeCache(path, source, texture))
+        fprintf(stderr, "Warning: Failed to write texture cache for %s\n", path);
+
+    return 1;
+}
+
+bool Texture_create(Texture &texture, const u32 *pixels, i32 width, i32 height, TEXTURE_LAYOUT layout)
+{
+    TRACE_FUNCTION();
+
+    texture = {};
+
+    if(width <= 0 || height <= 0)
+        return false;
+
+    size_t offsets[TEXTURE_MAX_LEVELS];
+    u32 levelCount;
+    u32 *base = (u32*) Vertex_alignedAlloc(Texture_chainLayout(width, height, LAYOUT_LINEAR, offsets, levelCount));
+
+    if(!base)
+        return false;
+
+    Texture_assignLevels(texture, base, width, height, LAYOUT_LINEAR);
+    texture.storage = TEXTURE_OWNED;
+    memcpy(base, pixels, (size_t) width * height * sizeof(u32));
+
+    for(u32 level = 1; level < texture.levelCount; level++)
+        Texture_buildLevel(texture.levels[level - 1], texture.levels[level]);
+
+    if(layout == LAYOUT_LINEAR)
+        return true;
+
+    // Mips are filtered row-major, then every level is converted
+    Texture linear = texture;
+    u32 *blocked = (u32*) Vertex_alignedAlloc(Texture_chainLayout(width, height, layout, offsets, levelCount));
+
+    if(!blocked)
+    {
+        Texture_free(texture);
+        return false;
+    }
+
+    Texture_assignLevels(texture, blocked, width, height, layout);
+
+    for(u32 level = 0; level < texture.levelCount; level++)
+        Texture_blockLevel(linear.levels[level], texture.levels[level]);
+
+    Vertex_alignedFree(base);
+    return true;
+}
+
+void Texture_free(Texture &texture)
+{
+    if(texture.storage == TEXTURE_OWNED)
+        Vertex_alignedFree(texture.pixels);
+    else if(texture.storage == TEXTURE_MAPPED)
+        Cache_unmapFile(texture.mapping, texture.mappingSize);
+
+    texture = {};
+}
+
+float Texture_lod(const Texture &texture, float du, float dv)
+{
+    float texelsX = fabsf(du) * texture.width;
+    float texelsY = fabsf(dv) * texture.height;
+    float texels = texelsX > texelsY ? texelsX : texelsY;
+
+    if(texels <= 1.0f)
+        return 0.0f;
+
+    float lod = log2f(texels);
+    float maxLod = (float)(texture.levelCount - 1);
+    return lod < maxLod ? lod : maxLod;
+}
+
+static i32 Texture_clamp(i32 value, i32 lo, i32 hi)
+{
+    return value < lo ? lo : (value > hi ? hi : value);
+}
+
+// Offset of texel (tx, ty) in the walk's level
+static inline size_t Texture_texelIndex(const TextureWalk &walk, i32 tx, i32 ty)
+{
+    if(walk.layout == LAYOUT_BLOCKED)
+    {
+        size_t block = (size_t)(ty >> 2) * walk.blocksPerRow + (tx >> 2);
+        return (block << 4) | ((ty & 3) << 2) | (tx & 3);
+    }
+
+    return (size_t) ty * walk.width + tx;
+}
+
+// Per channel a + (b - a) * weight / 256, rounded
+static u32 Texture_lerpTexel(u32 a, u32 b, u32 weight)
+{
+    u32 result = 0;
+
+    for(u32 shift = 0; shift < 32; shift += 8)
+    {
+        u32 ca = (a >> shift) & 0xFF;
+        u32 cb = (b >> shift) & 0xFF;
+        result |= ((ca * (256 - weight) + cb * weight + 128) >> 8) << shift;
+    }
+
+    return result;
+}
+
+void Texture_nearestScalar(const TextureWalk &walk, u32 count, u32 *dst)
+{
+    i32 x = walk.x, y = walk.y;
+
+    for(u32 i = 0; i < count; i++, x += walk.dx, y += walk.dy)
+    {
+        i32 tx = Texture_clamp(x >> 16, 0, walk.width - 1);
+        i32 ty = Texture_clamp(y >> 16, 0, walk.height - 1);
+        dst[i] = walk.pixels[Texture_texelIndex(walk, tx, ty)];
+    }
+}
+
+void Texture_bilinearScalar(const TextureWalk &walk, u32 count, u32 *dst)
+{
+    i32 x = walk.x, y = walk.y;
+
+    for(u32 i = 0; i < count; i++, x += walk.dx, y += walk.dy)
+    {
+        i32 x0 = Texture_clamp(x >> 16, 0, walk.width - 1);
+        i32 x1 = Texture_clamp((x >> 16) + 1, 0, walk.width - 1);
+        i32 y0 = Texture_clamp(y >> 16, 0, walk.height - 1);
+        i32 y1 = Texture_clamp((y >> 16) + 1, 0, walk.height - 1);
+        const u32 *pixels = walk.pixels;
+
+        u32 fx = (x >> 8) & 0xFF;
+        u32 fy = (y >> 8) & 0xFF;
+
+        u32 top = Texture_lerpTexel(pixels[Texture_texelIndex(walk, x0, y0)], pixels[Texture_texelIndex(walk, x1, y0)], fx);
+        u32 bottom = Texture_lerpTexel(pixels[Texture_texelIndex(walk, x0, y1)], pixels[Texture_texelIndex(walk, x1, y1)], fx);
+        dst[i] = Texture_lerpTexel(top, bottom, fy);
+    }
+}
+
+void Texture_lerpScalar(const u32 *a, const u32 *b, u32 weight, u32 count, u32 *dst)
+{
+    for(u32 i = 0; i < count; i++)
+        dst[i] = Texture_lerpTexel(a[i], b[i], weight);
+}
+
+#ifdef SIMD_X86
+
+// Lerps 4 texels in 16-bit lanes. weights holds each texel's weight (0..255)
+// in both halves of its 32-bit lane.
+SIMD_TARGET("sse2")
+static inline __m128i Texture_lerp4(__m128i a, __m128i b, __m128i weights)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i full = _mm_set1_epi16(256);
+    __m128i half = _mm_set1_epi16(128);
+
+    __m128i weightLo = _mm_unpacklo_epi32(weights, weights);
+    __m128i weightHi = _mm_unpackhi_epi32(weights, weights);
+
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), _mm_sub_epi16(full, weightLo)),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weightLo));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), _mm_sub_epi16(full, weightHi)),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weightHi));
+
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, half), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, half), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+SIMD_TARGET("avx2")
+static inline __m256i Texture_lerp8(__m256i a, __m256i b, __m256i weights)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i full = _mm256_set1_epi16(256);
+    __m256i half = _mm256_set1_epi16(128);
+
+    __m256i weightLo = _mm256_unpacklo_epi32(weights, weights);
+    __m256i weightHi = _mm256_unpackhi_epi32(weights, weights);
+
+    __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_sub_epi16(full, weightLo)),
+                                  _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), weightLo));
+    __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_sub_epi16(full, weightHi)),
+                                  _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), weightHi));
+
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, half), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, half), 8);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+// SSE2 has no gather or 32-bit multiply: addresses are scalar, filtering is vector
+SIMD_TARGET("sse2")
+void Texture_bilinearSSE2(const TextureWalk &walk, u32 count, u32 *dst)
+{
+    i32 x = walk.x, y = walk.y;
+
+    u32 i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        alignas(16) u32 c00[4], c10[4], c01[4], c11[4], fx[4], fy[4];
+
+        for(u32 lane = 0; lane < 4; lane++, x += walk.dx, y += walk.dy)
+        {
+            i32 x0 = Texture_clamp(x >> 16, 0, walk.width - 1);
+            i32 x1 = Texture_clamp((x >> 16) + 1, 0, walk.width - 1);
+            i32 y0 = Texture_clamp(y >> 16, 0, walk.height - 1);
+            i32 y1 = Texture_clamp((y >> 16) + 1, 0, walk.height - 1);
+
+            c00[lane] = walk.pixels[Texture_texelIndex(walk, x0, y0)];
+            c10[lane] = walk.pixels[Texture_texelIndex(walk, x1, y0)];
+            c01[lane] = walk.pixels[Texture_texelIndex(walk, x0, y1)];
+            c11[lane] = walk.pixels[Texture_texelIndex(walk, x1, y1)];
+            fx[lane] = ((x >> 8) & 0xFF) * 0x10001;
+            fy[lane] = ((y >> 8) & 0xFF) * 0x10001;
+        }
+
+        __m128i weightX = _mm_load_si128((const __m128i*) fx);
+        __m128i top = Texture_lerp4(_mm_load_si128((const __m128i*) c00), _mm_load_si128((const __m128i*) c10), weightX);
+        __m128i bottom = Texture_lerp4(_mm_load_si128((const __m128i*) c01), _mm_load_si128((const __m128i*) c11), weightX);
+        _mm_storeu_si128((__m128i*)(dst + i), Texture_lerp4(top, bottom, _mm_load_si128((const __m128i*) fy)));
+    }
+
+    TextureWalk rest = walk;
+    rest.x = x;
+    rest.y = y;
+    Texture_bilinearScalar(rest, count - i, dst + i);
+}
+
+SIMD_TARGET("sse2")
+void Texture_lerpSSE2(const u32 *a, const u32 *b, u32 weight, u32 count, u32 *dst)
+{
+    __m128i weights = _mm_set1_epi32((int)(weight * 0x10001));
+
+    u32 i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(dst + i), Texture_lerp4(va, vb, weights));
+    }
+
+    Texture_lerpScalar(a + i, b + i, weight, count - i, dst + i);
+}
+
+// Lane positions of 8 consecutive pixels and the step to the next 8
+SIMD_TARGET("avx2")
+static inline void Texture_walkLanes(const TextureWalk &walk, __m256i &x, __m256i &y, __m256i &stepX, __m256i &stepY)
+{
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    x = _mm256_add_epi32(_mm256_set1_epi32(walk.x), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(walk.dx)));
+    y = _mm256_add_epi32(_mm256_set1_epi32(walk.y), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(walk.dy)));
+    stepX = _mm256_set1_epi32(walk.dx * 8);
+    stepY = _mm256_set1_epi32(walk.dy * 8);
+}
+
+SIMD_TARGET("avx2")
+static inline __m256i Texture_clamp8(__m256i value, __m256i hi)
+{
+    return _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()), hi);
+}
+
+// Gather indices of texels (tx, ty). Row-major stride is the width, blocked
+// stride is blocksPerRow.
+SIMD_TARGET("avx2")
+static inline __m256i Texture_index8(bool blocked, __m256i stride, __m256i tx, __m256i ty)
+{
+    if(!blocked)
+        return _mm256_add_epi32(_mm256_mullo_epi32(ty, stride), tx);
+
+    __m256i three = _mm256_set1_epi32(3);
+    __m256i block = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_srai_epi32(ty, 2), stride), _mm256_srai_epi32(tx, 2));
+    __m256i inner = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(ty, three), 2), _mm256_and_si256(tx, three));
+    return _mm256_or_si256(_mm256_slli_epi32(block, 4), inner);
+}
+
+SIMD_TARGET("avx2")
+void Texture_nearestAVX2(const TextureWalk &walk, u32 count, u32 *dst)
+{
+    __m256i x, y, stepX, stepY;
+    Texture_walkLanes(walk, x, y, stepX, stepY);
+
+    __m256i maxX = _mm256_set1_epi32(walk.width - 1);
+    __m256i maxY = _mm256_set1_epi32(walk.height - 1);
+    bool blocked = walk.layout == LAYOUT_BLOCKED;
+    __m256i stride = _mm256_set1_epi32(blocked ? walk.blocksPerRow : walk.width);
+
+    u32 i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i tx = Texture_clamp8(_mm256_srai_epi32(x, 16), maxX);
+        __m256i ty = Texture_clamp8(_mm256_srai_epi32(y, 16), maxY);
+        __m256i index = Texture_index8(blocked, stride, tx, ty);
+
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_i32gather_epi32((const int*) walk.pixels, index, 4));
+
+        x = _mm256_add_epi32(x, stepX);
+        y = _mm256_add_epi32(y, stepY);
+    }
+
+    TextureWalk rest = walk;
+    rest.x = walk.x + (i32) i * walk.dx;
+    rest.y = walk.y + (i32) i * walk.dy;
+    Texture_nearestScalar(rest, count - i, dst + i);
+}
+
+SIMD_TARGET("avx2")
+void Texture_bilinearAVX2(const TextureWalk &walk, u32 count, u32 *dst)
+{
+    __m256i x, y, stepX, stepY;
+    Texture_walkLanes(walk, x, y, stepX, stepY);
+
+    __m256i maxX = _mm256_set1_epi32(walk.width - 1);
+    __m256i maxY = _mm256_set1_epi32(walk.height - 1);
+    bool blocked = walk.layout == LAYOUT_BLOCKED;
+    __m256i stride = _mm256_set1_epi32(blocked ? walk.blocksPerRow : walk.width);
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i fraction = _mm256_set1_epi32(0xFF);
+    const int *pixels = (const int*) walk.pixels;
+
+    u32 i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m256i xi = _mm256_srai_epi32(x, 16);
+        __m256i yi = _mm256_srai_epi32(y, 16);
+        __m256i x0 = Texture_clamp8(xi, maxX);
+        __m256i x1 = Texture_clamp8(_mm256_add_epi32(xi, one), maxX);
+        __m256i y0 = Texture_clamp8(yi, maxY);
+        __m256i y1 = Texture_clamp8(_mm256_add_epi32(yi, one), maxY);
+
+        __m256i c00 = _mm256_i32gather_epi32(pixels, Texture_index8(blocked, stride, x0, y0), 4);
+        __m256i c10 = _mm256_i32gather_epi32(pixels, Texture_index8(blocked, stride, x1, y0), 4);
+        __m256i c01 = _mm256_i32gather_epi32(pixels, Texture_index8(blocked, stride, x0, y1), 4);
+        __m256i c11 = _mm256_i32gather_epi32(pixels, Texture_index8(blocked, stride, x1, y1), 4);
+
+        // Weight in both 16-bit halves of each lane
+        __m256i fx = _mm256_and_si256(_mm256_srli_epi32(x, 8), fraction);
+        __m256i fy = _mm256_and_si256(_mm256_srli_epi32(y, 8), fraction);
+        fx = _mm256_or_si256(fx, _mm256_slli_epi32(fx, 16));
+        fy = _mm256_or_si256(fy, _mm256_slli_epi32(fy, 16));
+
+        __m256i top = Texture_lerp8(c00, c10, fx);
+        __m256i bottom = Texture_lerp8(c01, c11, fx);
+        _mm256_storeu_si256((__m256i*)(dst + i), Texture_lerp8(top, bottom, fy));
+
+        x = _mm256_add_epi32(x, stepX);
+        y = _mm256_add_epi32(y, stepY);
+    }
+
+    TextureWalk rest = walk;
+    rest.x = walk.x + (i32) i * walk.dx;
+    rest.y = walk.y + (i32) i * walk.dy;
+    Texture_bilinearScalar(rest, count - i, dst + i);
+}
+
+#else
+
+void Texture_nearestAVX2(const TextureWalk &walk, u32 count, u32 *dst)  { Texture_nearestScalar(walk, count, dst); }
+void Texture_bilinearSSE2(const TextureWalk &walk, u32 count, u32 *dst) { Texture_bilinearScalar(walk, count, dst); }
+void Texture_bilinearAVX2(const TextureWalk &walk, u32 count, u32 *dst) { Texture_bilinearScalar(walk, count, dst); }
+void Texture_lerpSSE2(const u32 *a, const u32 *b, u32 weight, u32 count, u32 *dst) { Texture_lerpScalar(a, b, weight, count, dst); }
+
+#endif
+
+// Fixed-point walk through one level. The start is computed for pixel 0 and
+// stepped in integers, so pixel first + i lands on the same position however
+// the row is split.
+static TextureWalk Texture_walk(const Texture &texture, u32 level, bool bilinear, float u, float v, float du, float dv, i32 first)
+{
+    const TextureLevel &source = texture.levels[level];
+    double scaleX = source.width * 65536.0;
+    double scaleY = source.height * 65536.0;
+    double offset = bilinear ? 32768.0 : 0.0;
+
+    TextureWalk walk;
+    walk.pixels = source.pixels;
+    walk.width = source.width;
+    walk.height = source.height;
+    walk.layout = texture.layout;
+    walk.blocksPerRow = source.blocksPerRow;
+    walk.dx = (i32) floor(du * scaleX + 0.5);
+    walk.dy = (i32) floor(dv * scaleY + 0.5);
+    walk.x = (i32)((i64) floor(u * scaleX - offset + 0.5) + (i64) first * walk.dx);
+    walk.y = (i32)((i64) floor(v * scaleY - offset + 0.5) + (i64) first * walk.dy);
+    return walk;
+}
+
+static void Texture_nearestRow(const TextureWalk &walk, u32 count, u32 *dst)
+{
+    if(simdLevel >= SIMD_AVX2)
+        Texture_nearestAVX2(walk, count, dst);
+    else
+        Texture_nearestScalar(walk, count, dst);
+}
+
+// AVX-512 machines run the AVX2 kernels, gathers are no wider per texel there
+static void Texture_bilinearRow(const TextureWalk &walk, u32 count, u32 *dst)
+{
+    switch(simdLevel)
+    {
+        case SIMD_AVX512:
+        case SIMD_AVX2: Texture_bilinearAVX2(walk, count, dst);   break;
+        case SIMD_SSE2: Texture_bilinearSSE2(walk, count, dst);   break;
+        default:        Texture_bilinearScalar(walk, count, dst); break;
+    }
+}
+
+void Texture_sampleRow(const Texture &texture, TEXTURE_FILTER filter, float lod,
+                       float u, float v, float du, float dv, i32 first, u32 count, u32 *dst)
+{
+    if(!texture.levelCount || !count)
+        return;
+
+    i32 lastLevel = (i32) texture.levelCount - 1;
+
+    if(filter != FILTER_TRILINEAR || lod <= 0.0f || lod >= (float) lastLevel)
+    {
+        // Nearest level; trilinear degenerates to bilinear outside the chain
+        u32 level = (u32) Texture_clamp((i32) floorf(lod + 0.5f), 0, lastLevel);
+        bool bilinear = filter != FILTER_NEAREST;
+        TextureWalk walk = Texture_walk(texture, level, bilinear, u, v, du, dv, first);
+
+        if(bilinear)
+            Texture_bilinearRow(walk, count, dst);
+        else
+            Texture_nearestRow(walk, count, dst);
+
+        return;
+    }
+
+    u32 level = (u32) floorf(lod);
+    u32 weight = (u32)((lod - (float) level) * 256.0f);
+    if(weight > 255) weight = 255;
+
+    // Both levels are filtered into chunks on the stack, then blended
+    const u32 CHUNK = 256;
+    u32 fine[CHUNK];
+    u32 coarse[CHUNK];
+
+    for(u32 done = 0; done < count; done += CHUNK)
+    {
+        u32 chunk = count - done < CHUNK ? count - done : CHUNK;
+        TextureWalk walkFine = Texture_walk(texture, level, true, u, v, du, dv, first + (i32) done);
+        TextureWalk walkCoarse = Texture_walk(texture, level + 1, true, u, v, du, dv, first + (i32) done);
+
+        Texture_bilinearRow(walkFine, chunk, fine);
+        Texture_bilinearRow(walkCoarse, chunk, coarse);
+
+        if(simdLevel >= SIMD_SSE2)
+            Texture_lerpSSE2(fine, coarse, weight, chunk, dst + done);
+        else
+            Texture_lerpScalar(fine, coarse, weight, chunk, dst + done);
+    }
+}
+
+u32 Texture_sample(const Texture &texture, TEXTURE_FILTER filter, float lod, float u, float v)
+{
+    u32 result = 0;
+    Texture_sampleRow(texture, filter, lod, u, v, 0.0f, 0.0f, 0, 1, &result);
+    return result;
+}
@@ -0,0 +1,391 @@
+#include "rasterizer_tiles.h"
+#include "rasterizer_simd.h"
+#include "rasterizer_jobs.h"
+#include "rasterizer_trace.h"
+
+static RasterRect Queue_fullScreen(RenderQueue &queue)
+{
+    RasterRect full = {0, 0, (i32) queue.width, (i32) queue.height};
+    return full;
+}
+
+static RenderCommand &Queue_push(RenderQueue &queue, RENDER_COMMAND_TYPE type, u32 color, RasterRect bounds)
+{
+    queue.commands.emplace_back();
+
+    RenderCommand &command = queue.commands.back();
+    command.type = type;
+    command.color = color;
+    command.depth = 0;
+    command.bounds = Raster_intersectRect(bounds, Queue_fullScreen(queue));
+    return command;
+}
+
+void Queue_begin(RenderQueue &queue, u32 width, u32 height)
+{
+    // Keeps the allocation from the previous frame
+    queue.commands.clear();
+    queue.width = width;
+    queue.height = height;
+    queue.cull = {CULL_NONE, WINDING_CLOCKWISE};
+
+    Layer_beginFrame();
+}
+
+void Queue_setCull(RenderQueue &queue, CULL_MODE mode, WINDING frontFace)
+{
+    queue.cull = {mode, frontFace};
+}
+
+void Queue_clear(RenderQueue &queue, u32 color)
+{
+    Queue_push(queue, COMMAND_CLEAR, color, Queue_fullScreen(queue));
+}
+
+void Queue_clearDepth(RenderQueue &queue, float depth)
+{
+    RenderCommand &command = Queue_push(queue, COMMAND_CLEAR_DEPTH, 0, Queue_fullScreen(queue));
+    command.depth = depth;
+}
+
+void Queue_drawBackgroundGrid(RenderQueue &queue, i32 step, GRID_MODE mode)
+{
+    // A grid right after a clear (depth clears don't touch color) becomes
+    // one copy of the cached clear + grid layer. With every layer pinned by
+    // this frame's backgrounds it stays a clear and an uncached grid.
+    size_t last = queue.commands.size();
+    while(last > 0 && queue.commands[last - 1].type == COMMAND_CLEAR_DEPTH)
+        last--;
+
+    if(last > 0 && queue.commands[last - 1].type == COMMAND_CLEAR)
+    {
+        RenderCommand &clear = queue.commands[last - 1];
+        GridLayer *layer = Layer_grid(step, mode, clear.color, queue.width, queue.height, true);
+
+        if(layer)
+        {
+            clear.type = COMMAND_BACKGROUND;
+            clear.background.layer = layer;
+            return;
+        }
+    }
+
+    RenderCommand &command = Queue_push(queue, COMMAND_GRID, 0, Queue_fullScreen(queue));
+    command.grid.step = step;
+    command.grid.mode = mode;
+}
+
+void Queue_drawRectangle(RenderQueue &queue, i32 x0, i32 y0, i32 w, i32 h, u32 color, RECT_MODE mode)
+{
+    RasterRect rect = {x0, y0, x0 + w + 1, y0 + h + 1};
+
+    RenderCommand &command = Queue_push(queue, COMMAND_RECTANGLE, color, rect);
+    command.rectangle.rect = rect;
+    command.rectangle.mode = mode;
+}
+
+void Queue_drawLine(RenderQueue &queue, i32 x0, i32 y0, i32 x1, i32 y1, u32 color)
+{
+    RenderCommand &command = Queue_push(queue, COMMAND_LINE, color, Raster_lineBounds(x0, y0, x1, y1));
+    command.line.x0 = x0;
+    command.line.y0 = y0;
+    command.line.x1 = x1;
+    command.line.y1 = y1;
+}
+
+void Queue_drawLines(RenderQueue &queue, const LineSegment *segments, u32 count)
+{
+    if(count == 0)
+        return;
+
+    RasterRect bounds = Raster_lineBounds(segments[0].x0, segments[0].y0, segments[0].x1, segments[0].y1);
+    for(u32 i = 1; i < count; i++)
+    {
+        RasterRect b = Raster_lineBounds(segments[i].x0, segments[i].y0, segments[i].x1, segments[i].y1);
+        bounds.minX = b.minX < bounds.minX ? b.minX : bounds.minX;
+        bounds.minY = b.minY < bounds.minY ? b.minY : bounds.minY;
+        bounds.maxX = b.maxX > bounds.maxX ? b.maxX : bounds.maxX;
+        bounds.maxY = b.maxY > bounds.maxY ? b.maxY : bounds.maxY;
+    }
+
+    RenderCommand &command = Queue_push(queue, COMMAND_LINES, 0, bounds);
+    command.lines.segments = segments;
+    command.lines.count = count;
+}
+
+void Queue_drawTriangle(RenderQueue &queue, Vector2 v0, Vector2 v1, Vector2 v2, u32 color)
+{
+    // Setup runs once here, every tile reuses it
+    TriangleSetup setup;
+    if(!Raster_setupTriangle(setup, v0, v1, v2, queue.cull))
+        return;
+
+    RenderCommand &command = Queue_push(queue, COMMAND_TRIANGLE, color, setup.bounds);
+    command.triangle = setup;
+}
+
+void Queue_drawRectangleDepth(RenderQueue &queue, i32 x0, i32 y0, i32 w, i32 h, float depth, u32 color)
+{
+    TriangleSetup setup;
+    RasterRect rect = {x0, y0, x0 + w + 1, y0 + h + 1};
+    Raster_setupRectangle(setup, rect, depth);
+
+    RenderCommand &command = Queue_push(queue, COMMAND_TRIANGLE, color, setup.bounds);
+    command.triangle = setup;
+}
+
+void Queue_drawTriangleDepth(RenderQueue &queue, Vector3 v0, Vector3 v1, Vector3 v2, u32 color)
+{
+    TriangleSetup setup;
+    if(!Raster_setupTriangleDepth(setup, v0, v1, v2, queue.cull))
+        return;
+
+    RenderCommand &command = Queue_push(queue, COMMAND_TRIANGLE, color, setup.bounds);
+    command.triangle = setup;
+}
+
+void Queue_blitImage(RenderQueue &queue, u32 *imgPixels, int imgW, int imgH, int x, int y, int w, int h, BLIT_MODE mode)
+{
+    FrameBuffer target = {nullptr, queue.width, queue.height, nullptr};
+
+    RenderCommand &command = Queue_push(queue, COMMAND_BLIT, 0, Raster_blitRect(target, x, y, w, h));
+    command.blit.pixels = imgPixels;
+    command.blit.imgW = imgW;
+    command.blit.imgH = imgH;
+    command.blit.x = x;
+    command.blit.y = y;
+    command.blit.w = w;
+    command.blit.h = h;
+    command.blit.mode = mode;
+}
+
+void Queue_blitTexture(RenderQueue &queue, const Texture &texture, int x, int y, int w, int h, TEXTURE_FILTER filter)
+{
+    if(w <= 0 || h <= 0)
+        return;
+
+    RasterRect bounds = {x, y, x + w, y + h};
+
+    RenderCommand &command = Queue_push(queue, COMMAND_BLIT_TEXTURE, 0, bounds);
+    command.blitTexture.texture = &texture;
+    command.blitTexture.x = x;
+    command.blitTexture.y = y;
+    command.blitTexture.w = w;
+    command.blitTexture.h = h;
+    command.blitTexture.filter = filter;
+}
+
+static void Queue_executeCommand(FrameBuffer &buffer, RenderCommand &command, RasterRect clip)
+{
+    switch(command.type)
+    {
+        case COMMAND_CLEAR:
+        {
+            if(clip.minX == 0 && clip.minY == 0 && clip.maxX == (i32) buffer.width && clip.maxY == (i32) buffer.height)
+                Simd_clear(buffer.buffer, (size_t) buffer.width * buffer.height, command.color);
+            else
+                Raster_fillRect(buffer, clip, clip, command.color);
+        } break;
+
+        case COMMAND_CLEAR_DEPTH:
+        {
+            Raster_clearDepth(buffer, clip, command.depth);
+        } break;
+
+        case COMMAND_GRID:
+        {
+            Raster_grid(buffer, command.grid.step, command.grid.mode, clip);
+        } break;
+
+        case COMMAND_BACKGROUND:
+        {
+            Layer_drawGrid(buffer, *command.background.layer, clip);
+        } break;
+
+        case COMMAND_RECTANGLE:
+        {
+            if(command.rectangle.mode == FILL)
+                Raster_fillRect(buffer, command.rectangle.rect, clip, command.color);
+            else
+                Raster_outlineRect(buffer, command.rectangle.rect, clip, command.color);
+        } break;
+
+        case COMMAND_LINE:
+        {
+            Raster_line(buffer, command.line.x0, command.line.y0, command.line.x1, command.line.y1, clip, command.color);
+        } break;
+
+        case COMMAND_LINES:
+        {
+            Raster_lines(buffer, command.lines.segments, command.lines.count, clip);
+        } break;
+
+        case COMMAND_TRIANGLE:
+        {
+            Raster_fillTriangle(buffer, command.triangle, clip, command.color);
+        } break;
+
+        case COMMAND_BLIT:
+        {
+            Raster_blit(buffer, command.blit.pixels, command.blit.imgW, command.blit.imgH,
+                        command.blit.x, command.blit.y, command.blit.w, command.blit.h, command.blit.mode, clip);
+        } break;
+
+        case COMMAND_BLIT_TEXTURE:
+        {
+            Raster_blitTexture(buffer, *command.blitTexture.texture, command.blitTexture.x, command.blitTexture.y,
+                               command.blitTexture.w, command.blitTexture.h, command.blitTexture.filter, clip);
+        } break;
+    }
+}
+
+void Queue_execute(FrameBuffer &buffer, RenderQueue &queue)
+{
+    TRACE_FUNCTION();
+
+    RasterRect full = {0, 0, (i32) buffer.width, (i32) buffer.height};
+
+    for(RenderCommand &command : queue.commands)
+        Queue_executeCommand(buffer, command, full);
+}
+
+// Adds every segment of a line batch to the tiles its own bounds overlap
+static void Tiles_binLines(TileBins &bins, RenderQueue &queue, u32 commandIndex)
+{
+    RenderCommand &command = queue.commands[commandIndex];
+    RasterRect screen = {0, 0, (i32) queue.width, (i32) queue.height};
+    RasterRect b = command.bounds;
+
+    // Segment counts start as the bin sizes and become counts at the end
+    for(u32 ty = b.minY / TILE_SIZE; ty <= (u32)(b.maxY - 1) / TILE_SIZE; ty++)
+    {
+        for(u32 tx = b.minX / TILE_SIZE; tx <= (u32)(b.maxX - 1) / TILE_SIZE; tx++)
+        {
+            u32 tile = ty * bins.tilesX + tx;
+            bins.bins[tile].push_back(commandIndex);
+            bins.lineGroups[tile].push_back((u32) bins.lineBins[tile].size());
+        }
+    }
+
+    for(u32 i = 0; i < command.lines.count; i++)
+    {
+        const LineSegment &line = command.lines.segments[i];
+        RasterRect lb = Raster_intersectRect(Raster_lineBounds(line.x0, line.y0, line.x1, line.y1), screen);
+
+        if(lb.minX >= lb.maxX || lb.minY >= lb.maxY)
+            continue;
+
+        for(u32 ty = lb.minY / TILE_SIZE; ty <= (u32)(lb.maxY - 1) / TILE_SIZE; ty++)
+        {
+            for(u32 tx = lb.minX / TILE_SIZE; tx <= (u32)(lb.maxX - 1) / TILE_SIZE; tx++)
+                bins.lineBins[ty * bins.tilesX + tx].push_back(line);
+        }
+    }
+
+    for(u32 ty = b.minY / TILE_SIZE; ty <= (u32)(b.maxY - 1) / TILE_SIZE; ty++)
+    {
+        for(u32 tx = b.minX / TILE_SIZE; tx <= (u32)(b.maxX - 1) / TILE_SIZE; tx++)
+        {
+            u32 tile = ty * bins.tilesX + tx;
+            u32 &group = bins.lineGroups[tile].back();
+            group = (u32) bins.lineBins[tile].size() - group;
+        }
+    }
+}
+
+void Tiles_bin(TileBins &bins, RenderQueue &queue)
+{
+    TRACE_FUNCTION();
+
+    bins.tilesX = (queue.width + TILE_SIZE - 1) / TILE_SIZE;
+    bins.tilesY = (queue.height + TILE_SIZE - 1) / TILE_SIZE;
+    bins.bins.resize(bins.tilesX * bins.tilesY);
+    bins.lineBins.resize(bins.tilesX * bins.tilesY);
+    bins.lineGroups.resize(bins.tilesX * bins.tilesY);
+
+    for(std::vector<u32> &bin : bins.bins)
+        bin.clear();
+
+    for(std::vector<LineSegment> &bin : bins.lineBins)
+        bin.clear();
+
+    for(std::vector<u32> &groups : bins.lineGroups)
+        groups.clear();
+
+    for(u32 i = 0; i < queue.commands.size(); i++)
+    {
+        RasterRect b = queue.commands[i].bounds;
+
+        if(b.minX >= b.maxX || b.minY >= b.maxY)
+            continue;
+
+        if(queue.commands[i].type == COMMAND_LINES)
+        {
+            Tiles_binLines(bins, queue, i);
+            continue;
+        }
+
+        u32 tx0 = b.minX / TILE_SIZE;
+        u32 ty0 = b.minY / TILE_SIZE;
+        u32 tx1 = (b.maxX - 1) / TILE_SIZE;
+        u32 ty1 = (b.maxY - 1) / TILE_SIZE;
+
+        for(u32 ty = ty0; ty <= ty1; ty++)
+        {
+            for(u32 tx = tx0; tx <= tx1; tx++)
+                bins.bins[ty * bins.tilesX + tx].push_back(i);
+        }
+    }
+}
+
+struct TileJob
+{
+    FrameBuffer *buffer;
+    RenderQueue *queue;
+    TileBins *bins;
+};
+
+static void Tiles_renderTile(void *context, u32 index, u32 worker)
+{
+    (void) worker;
+
+    TRACE_SCOPE("Tiles_renderTile");
+
+    TileJob &job = *(TileJob*) context;
+    FrameBuffer &buffer = *job.buffer;
+
+    i32 tx = index % job.bins->tilesX;
+    i32 ty = index / job.bins->tilesX;
+
+    RasterRect clip;
+    clip.minX = tx * TILE_SIZE;
+    clip.minY = ty * TILE_SIZE;
+    clip.maxX = clip.minX + TILE_SIZE < (i32) buffer.width ? clip.minX + TILE_SIZE : (i32) buffer.width;
+    clip.maxY = clip.minY + TILE_SIZE < (i32) buffer.height ? clip.minY + TILE_SIZE : (i32) buffer.height;
+
+    // Line batches draw only the segments binned to this tile
+    const LineSegment *lines = job.bins->lineBins[index].data();
+    const u32 *lineGroup = job.bins->lineGroups[index].data();
+
+    for(u32 commandIndex : job.bins->bins[index])
+    {
+        RenderCommand &command = job.queue->commands[commandIndex];
+
+        if(command.type == COMMAND_LINES)
+        {
+            Raster_lines(buffer, lines, *lineGroup, clip);
+            lines += *lineGroup++;
+            continue;
+        }
+
+        Queue_executeCommand(buffer, command, clip);
+    }
+}
+
+void Tiles_execute(FrameBuffer &buffer, RenderQueue &queue, TileBins &bins)
+{
+    TRACE_FUNCTION();
+
+    TileJob job = {&buffer, &queue, &bins};
+    Jobs_parallelFor(bins.tilesX * bins.tilesY, Tiles_renderTile, &job);
+}
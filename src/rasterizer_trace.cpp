@@ -0,0 +1,137 @@
+#include "rasterizer_trace.h"
+
+#ifdef RASTERIZER_TRACE
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <functional>
+
+// Events kept per thread, the oldest are overwritten once full
+const uint32_t TRACE_RING_CAPACITY = 1 << 16;
+
+struct TraceEvent
+{
+    const char *name;
+    uint64_t startNs;
+    uint64_t endNs;
+};
+
+// Single producer ring, only the owning thread writes. The export reads
+// the published head so recording never takes a lock.
+struct TraceRing
+{
+    TraceEvent events[TRACE_RING_CAPACITY];
+    std::atomic<uint64_t> head;
+    uint64_t threadId;
+};
+
+static std::mutex ringsMutex;
+static std::vector<TraceRing*> rings;
+
+static TraceRing *Trace_registerThread()
+{
+    TraceRing *ring = new TraceRing();
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->threadId = std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xFFFFFFFF;
+
+    // Taken once per thread, never on the recording path
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.push_back(ring);
+
+    return ring;
+}
+
+static thread_local TraceRing *threadRing = Trace_registerThread();
+
+uint64_t Trace_nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace_record(const char *name, uint64_t startNs, uint64_t endNs)
+{
+    TraceRing *ring = threadRing;
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+    TraceEvent &event = ring->events[head & (TRACE_RING_CAPACITY - 1)];
+    event.name = name;
+    event.startNs = startNs;
+    event.endNs = endNs;
+
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+TraceScope::TraceScope(const char *scopeName)
+{
+    name = scopeName;
+    startNs = Trace_nowNs();
+}
+
+TraceScope::~TraceScope()
+{
+    Trace_record(name, startNs, Trace_nowNs());
+}
+
+// Intended to run once recording threads are idle (e.g. at shutdown)
+int Trace_writeChromeJSON(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+
+    if(file == NULL)
+    {
+        printf("Error: Failed to open trace file for writing: %s\n", filename);
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+
+    // Timestamps are relative to the earliest retained event
+    uint64_t origin = UINT64_MAX;
+    for(TraceRing *ring : rings)
+    {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+
+        for(uint64_t i = first; i < head; i++)
+        {
+            uint64_t start = ring->events[i & (TRACE_RING_CAPACITY - 1)].startNs;
+            if(start < origin) origin = start;
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+    bool firstEvent = true;
+    for(TraceRing *ring : rings)
+    {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+
+        for(uint64_t i = first; i < head; i++)
+        {
+            TraceEvent &event = ring->events[i & (TRACE_RING_CAPACITY - 1)];
+
+            // Complete events ("X") take microsecond timestamps
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %llu, \"ts\": %.3f, \"dur\": %.3f}",
+                    firstEvent ? "" : ",\n",
+                    event.name,
+                    (unsigned long long) ring->threadId,
+                    (event.startNs - origin) / 1000.0,
+                    (event.endNs - event.startNs) / 1000.0);
+
+            firstEvent = false;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    return 1;
+}
+
+#endif
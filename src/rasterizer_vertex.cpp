@@ -0,0 +1,60 @@
+#include "rasterizer_vertex.h"
+
+#include <stdlib.h>
+
+void *Vertex_alignedAlloc(size_t size)
+{
+    // Rounded up so every array can be read in whole cache lines
+    size = (size + VERTEX_STREAM_ALIGNMENT - 1) & ~(size_t)(VERTEX_STREAM_ALIGNMENT - 1);
+
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, VERTEX_STREAM_ALIGNMENT);
+#else
+    return aligned_alloc(VERTEX_STREAM_ALIGNMENT, size);
+#endif
+}
+
+void Vertex_alignedFree(void *memory)
+{
+#if defined(_MSC_VER)
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+VertexStream Vertex_createStream(u32 capacity)
+{
+    VertexStream stream = {};
+    stream.x = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    stream.y = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    stream.z = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    stream.capacity = capacity;
+    return stream;
+}
+
+void Vertex_destroyStream(VertexStream &stream)
+{
+    Vertex_alignedFree(stream.x);
+    Vertex_alignedFree(stream.y);
+    Vertex_alignedFree(stream.z);
+    stream = {};
+}
+
+ProjectedStream Vertex_createProjected(u32 capacity)
+{
+    ProjectedStream stream = {};
+    stream.x = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    stream.y = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    stream.depth = (float*) Vertex_alignedAlloc(capacity * sizeof(float));
+    stream.capacity = capacity;
+    return stream;
+}
+
+void Vertex_destroyProjected(ProjectedStream &stream)
+{
+    Vertex_alignedFree(stream.x);
+    Vertex_alignedFree(stream.y);
+    Vertex_alignedFree(stream.depth);
+    stream = {};
+}